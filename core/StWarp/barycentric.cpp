@@ -2,6 +2,11 @@
 
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <cmath>
+
+#include "StWarp/cpu_dispatch.h"
+
 namespace StWarp {
 
 Vec3d computeBarycentricCoordinates(const Vec3d& c, const Vec3d& p0,
@@ -32,50 +37,168 @@ Vec3d computeBarycentricCoordinates(const Vec3d& c, const Vec3d& p0,
   return w;
 }
 
+// Real-Time Collision Detection, Ericson 2004, section 5.1.5
+Vec3d closestPointOnTriangle(const Vec3d& c, const Vec3d& p0, const Vec3d& p1,
+                             const Vec3d& p2) {
+  Vec3d ab = p1 - p0;
+  Vec3d ac = p2 - p0;
+  Vec3d ap = c - p0;
+  double d1 = ab.dot(ap);
+  double d2 = ac.dot(ap);
+  if (d1 <= 0.0 && d2 <= 0.0) return p0;
+
+  Vec3d bp = c - p1;
+  double d3 = ab.dot(bp);
+  double d4 = ac.dot(bp);
+  if (d3 >= 0.0 && d4 <= d3) return p1;
+
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+    double v = d1 / (d1 - d3);
+    return p0 + v * ab;
+  }
+
+  Vec3d cp = c - p2;
+  double d5 = ab.dot(cp);
+  double d6 = ac.dot(cp);
+  if (d6 >= 0.0 && d5 <= d6) return p2;
+
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+    double w = d2 / (d2 - d6);
+    return p0 + w * ac;
+  }
+
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    return p1 + w * (p2 - p1);
+  }
+
+  double denom = 1.0 / (va + vb + vc);
+  double v = vb * denom;
+  double w = vc * denom;
+  return p0 + ab * v + ac * w;
+}
+
 Vec4d computeBilinearCoordinates(const Vec3d& c, const Vec3d& p0,
                                  const Vec3d& p1, const Vec3d& p2,
                                  const Vec3d& p3) {
-  const double tol = 1e-6;
-  const int maxIter = 50;
-  double u = 0.5;
-  double v = 0.5;
-
-  for (int iter = 0; iter < maxIter; ++iter) {
-    Vec3d c_estimated = (1 - u) * (1 - v) * p0 + u * (1 - v) * p1 + u * v * p2 +
-                        (1 - u) * v * p3;
-    Vec3d F = c_estimated - c;
-    if (F.norm() < tol) {
-      break;
-    }
-    Vec3d Fu = -(1 - v) * p0 + (1 - v) * p1 + v * p2 - v * p3;
-    Vec3d Fv = -(1 - u) * p0 - u * p1 + u * p2 + (1 - u) * p3;
-
-    Mat2d J;
-    J(0, 0) = Fu.dot(Fu);
-    J(0, 1) = Fu.dot(Fv);
-    J(1, 0) = Fv.dot(Fu);
-    J(1, 1) = Fv.dot(Fv);
-
-    Vec2d rhs;
-    rhs(0) = -F.dot(Fu);
-    rhs(1) = -F.dot(Fv);
-
-    Vec2d delta = J.ldlt().solve(rhs);
-
-    u += delta(0);
-    v += delta(1);
-
-    u = clamp(u, 0.0, 1.0);
-    v = clamp(v, 0.0, 1.0);
-
-    if (delta.norm() < tol) {
-      break;
-    }
+  return computeBilinearCoordinates(c, setupBilinearQuad(p0, p1, p2, p3));
+}
+
+namespace {
+
+// One lane of the inverse bilinear map, h = c - p0. Both roots of the
+// quadratic are computed with the stable formula, which also covers the
+// parallel edges case k2 = 0, and the root inside [0, 1] is selected.
+inline void bilinearLane(double hx, double hy, double hz, const double* e,
+                         const double* f, const double* g,
+                         const double* axis_u, const double* axis_v,
+                         const double* e2, const double* f2, const double* g2,
+                         double k2, double kef, double& u_out,
+                         double& v_out) {
+  const double tiny = 1e-300;
+  double h2x = hx * axis_u[0] + hy * axis_u[1] + hz * axis_u[2];
+  double h2y = hx * axis_v[0] + hy * axis_v[1] + hz * axis_v[2];
+  double k1 = kef + h2x * g2[1] - h2y * g2[0];
+  double k0 = h2x * e2[1] - h2y * e2[0];
+
+  double disc = std::max(k1 * k1 - 4.0 * k0 * k2, 0.0);
+  double q = -0.5 * (k1 + std::copysign(std::sqrt(disc), k1));
+  q = std::abs(q) < tiny ? std::copysign(tiny, q) : q;
+  double v1 = k2 != 0.0 ? q / k2 : 1e30;
+  double v2 = k0 / q;
+
+  // u from v in the least squares sense of (h - f v) = u (e + g v)
+  double dx1 = e2[0] + g2[0] * v1, dy1 = e2[1] + g2[1] * v1;
+  double dx2 = e2[0] + g2[0] * v2, dy2 = e2[1] + g2[1] * v2;
+  double u1 = ((h2x - f2[0] * v1) * dx1 + (h2y - f2[1] * v1) * dy1) /
+              std::max(dx1 * dx1 + dy1 * dy1, tiny);
+  double u2 = ((h2x - f2[0] * v2) * dx2 + (h2y - f2[1] * v2) * dy2) /
+              std::max(dx2 * dx2 + dy2 * dy2, tiny);
+  double out1 = std::max(-u1, 0.0) + std::max(u1 - 1.0, 0.0) +
+                std::max(-v1, 0.0) + std::max(v1 - 1.0, 0.0);
+  double out2 = std::max(-u2, 0.0) + std::max(u2 - 1.0, 0.0) +
+                std::max(-v2, 0.0) + std::max(v2 - 1.0, 0.0);
+  bool first = out1 < out2;
+  double u = std::min(std::max(first ? u1 : u2, 0.0), 1.0);
+  double v = std::min(std::max(first ? v1 : v2, 0.0), 1.0);
+
+  // one Gauss-Newton step on |B(u, v) - c|^2 for the off plane part
+  double fu[3], fv[3], r[3];
+  for (int k = 0; k < 3; k++) {
+    fu[k] = e[k] + v * g[k];
+    fv[k] = f[k] + u * g[k];
   }
+  r[0] = u * e[0] + v * f[0] + u * v * g[0] - hx;
+  r[1] = u * e[1] + v * f[1] + u * v * g[1] - hy;
+  r[2] = u * e[2] + v * f[2] + u * v * g[2] - hz;
+  double j00 = fu[0] * fu[0] + fu[1] * fu[1] + fu[2] * fu[2];
+  double j01 = fu[0] * fv[0] + fu[1] * fv[1] + fu[2] * fv[2];
+  double j11 = fv[0] * fv[0] + fv[1] * fv[1] + fv[2] * fv[2];
+  double b0 = -(r[0] * fu[0] + r[1] * fu[1] + r[2] * fu[2]);
+  double b1 = -(r[0] * fv[0] + r[1] * fv[1] + r[2] * fv[2]);
+  double det = j00 * j11 - j01 * j01;
+  double inv_det = std::abs(det) > tiny ? 1.0 / det : 0.0;
+  u += (j11 * b0 - j01 * b1) * inv_det;
+  v += (j00 * b1 - j01 * b0) * inv_det;
+
+  u_out = std::min(std::max(u, 0.0), 1.0);
+  v_out = std::min(std::max(v, 0.0), 1.0);
+}
 
+}  // namespace
+
+BilinearQuad setupBilinearQuad(const Vec3d& p0, const Vec3d& p1,
+                               const Vec3d& p2, const Vec3d& p3) {
+  BilinearQuad quad;
+  quad.p0 = p0;
+  quad.e = p1 - p0;
+  quad.f = p3 - p0;
+  quad.g = p0 - p1 + p2 - p3;
+
+  // mean plane from the diagonals, falling back to the edges
+  Vec3d n = (p2 - p0).cross(p3 - p1);
+  if (n.squaredNorm() == 0.0) n = quad.e.cross(quad.f);
+  if (n.squaredNorm() == 0.0) n = quad.e.unitOrthogonal();
+  n.normalize();
+  Vec3d axis = quad.e.squaredNorm() > quad.f.squaredNorm() ? quad.e : quad.f;
+  if (axis.squaredNorm() == 0.0) axis = n.unitOrthogonal();
+  quad.axis_u = (axis - axis.dot(n) * n).normalized();
+  quad.axis_v = n.cross(quad.axis_u);
+
+  quad.e2 << quad.e.dot(quad.axis_u), quad.e.dot(quad.axis_v);
+  quad.f2 << quad.f.dot(quad.axis_u), quad.f.dot(quad.axis_v);
+  quad.g2 << quad.g.dot(quad.axis_u), quad.g.dot(quad.axis_v);
+  quad.k2 = quad.g2(0) * quad.f2(1) - quad.g2(1) * quad.f2(0);
+  quad.kef = quad.e2(0) * quad.f2(1) - quad.e2(1) * quad.f2(0);
+  return quad;
+}
+
+Vec4d computeBilinearCoordinates(const Vec3d& c, const BilinearQuad& quad) {
+  Vec3d h = c - quad.p0;
+  double u, v;
+  bilinearLane(h(0), h(1), h(2), quad.e.data(), quad.f.data(), quad.g.data(),
+               quad.axis_u.data(), quad.axis_v.data(), quad.e2.data(),
+               quad.f2.data(), quad.g2.data(), quad.k2, quad.kef, u, v);
   Vec4d w;
   w << (1 - u) * (1 - v), u * (1 - v), u * v, (1 - u) * v;
   return w;
 }
 
-}  // namespace StWarp
\ No newline at end of file
+STWARP_KERNEL
+void computeBilinearCoordinates(const BilinearQuad& quad, int n,
+                                const double* px, const double* py,
+                                const double* pz, double* u, double* v) {
+  const double ox = quad.p0(0), oy = quad.p0(1), oz = quad.p0(2);
+#pragma omp simd
+  for (int k = 0; k < n; k++) {
+    bilinearLane(px[k] - ox, py[k] - oy, pz[k] - oz, quad.e.data(),
+                 quad.f.data(), quad.g.data(), quad.axis_u.data(),
+                 quad.axis_v.data(), quad.e2.data(), quad.f2.data(),
+                 quad.g2.data(), quad.k2, quad.kef, u[k], v[k]);
+  }
+}
+
+}  // namespace StWarp
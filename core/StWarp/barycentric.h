@@ -13,10 +13,39 @@ inline T clamp(T value, T min, T max) {
 Vec3d computeBarycentricCoordinates(const Vec3d& c, const Vec3d& p0,
                                     const Vec3d& p1, const Vec3d& p2);
 
+// Closest point to c on the triangle (p0, p1, p2).
+Vec3d closestPointOnTriangle(const Vec3d& c, const Vec3d& p0, const Vec3d& p1,
+                             const Vec3d& p2);
+
 Vec4d computeBilinearCoordinates(const Vec3d& c, const Vec3d& p0,
                                  const Vec3d& p1, const Vec3d& p2,
                                  const Vec3d& p3);
 
+// Per quad setup of the closed form inverse bilinear map. The quad is
+// B(u, v) = p0 + u e + v f + u v g, with e, f, g also expressed in a 2D
+// basis of its mean plane.
+struct BilinearQuad {
+  Vec3d p0, e, f, g;
+  Vec3d axis_u, axis_v;
+  Vec2d e2, f2, g2;
+  // cross(g2, f2) and cross(e2, f2), the point independent terms of the
+  // quadratic in v
+  double k2, kef;
+};
+
+BilinearQuad setupBilinearQuad(const Vec3d& p0, const Vec3d& p1,
+                               const Vec3d& p2, const Vec3d& p3);
+
+// Inverse bilinear map of c by the quadratic formula in the mean plane plus
+// one Gauss-Newton step for non planar quads, (u, v) clamped to [0, 1].
+Vec4d computeBilinearCoordinates(const Vec3d& c, const BilinearQuad& quad);
+
+// Batched version for n points against one quad, writes (u, v) per point.
+// The bilinear weights are ((1-u)(1-v), u(1-v), uv, (1-u)v).
+void computeBilinearCoordinates(const BilinearQuad& quad, int n,
+                                const double* px, const double* py,
+                                const double* pz, double* u, double* v);
+
 }  // namespace StWarp
 
 #endif  // STWARP_BARYCENTRIC_H_
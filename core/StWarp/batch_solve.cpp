@@ -0,0 +1,92 @@
+#include "StWarp/batch_solve.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "StWarp/cpu_dispatch.h"
+
+namespace StWarp {
+
+namespace {
+
+// matrices per pass, the lanes stay on the stack
+const int kLanes = 64;
+// pivots below this fraction of their diagonal entry count as singular
+const double kPivotTolerance = 1e-12;
+
+}  // namespace
+
+STWARP_KERNEL
+void choleskySolve4(int n, const Mat4d* M, const Vec4d* p, Vec4d* q,
+                    bool* ok) {
+  // lower triangle of M and p, then of L and q
+  alignas(64) double a[10][kLanes];
+  alignas(64) double b[4][kLanes];
+  alignas(64) double good[kLanes];
+  for (int first = 0; first < n; first += kLanes) {
+    int count = std::min(kLanes, n - first);
+    for (int k = 0; k < count; k++) {
+      const Mat4d& Mk = M[first + k];
+      int e = 0;
+      for (int r = 0; r < 4; r++) {
+        for (int c = 0; c <= r; c++) a[e++][k] = Mk(r, c);
+        b[r][k] = p[first + k](r);
+      }
+    }
+
+#pragma omp simd
+    for (int k = 0; k < count; k++) {
+      // a[e] is entry (r, c) of the lower triangle at e = r (r + 1) / 2 + c
+      double a00 = a[0][k], a10 = a[1][k], a11 = a[2][k], a20 = a[3][k];
+      double a21 = a[4][k], a22 = a[5][k], a30 = a[6][k], a31 = a[7][k];
+      double a32 = a[8][k], a33 = a[9][k];
+
+      double d0 = a00;
+      double valid = d0 > kPivotTolerance * a00 ? 1.0 : 0.0;
+      double l00 = std::sqrt(std::max(d0, 1e-300));
+      double i0 = 1.0 / l00;
+      double l10 = a10 * i0, l20 = a20 * i0, l30 = a30 * i0;
+
+      double d1 = a11 - l10 * l10;
+      valid = d1 > kPivotTolerance * a11 ? valid : 0.0;
+      double l11 = std::sqrt(std::max(d1, 1e-300));
+      double i1 = 1.0 / l11;
+      double l21 = (a21 - l20 * l10) * i1;
+      double l31 = (a31 - l30 * l10) * i1;
+
+      double d2 = a22 - l20 * l20 - l21 * l21;
+      valid = d2 > kPivotTolerance * a22 ? valid : 0.0;
+      double l22 = std::sqrt(std::max(d2, 1e-300));
+      double i2 = 1.0 / l22;
+      double l32 = (a32 - l30 * l20 - l31 * l21) * i2;
+
+      double d3 = a33 - l30 * l30 - l31 * l31 - l32 * l32;
+      valid = d3 > kPivotTolerance * a33 ? valid : 0.0;
+      double l33 = std::sqrt(std::max(d3, 1e-300));
+      double i3 = 1.0 / l33;
+
+      // L y = p
+      double y0 = b[0][k] * i0;
+      double y1 = (b[1][k] - l10 * y0) * i1;
+      double y2 = (b[2][k] - l20 * y0 - l21 * y1) * i2;
+      double y3 = (b[3][k] - l30 * y0 - l31 * y1 - l32 * y2) * i3;
+      // L^T q = y
+      double q3 = y3 * i3;
+      double q2 = (y2 - l32 * q3) * i2;
+      double q1 = (y1 - l21 * q2 - l31 * q3) * i1;
+      double q0 = (y0 - l10 * q1 - l20 * q2 - l30 * q3) * i0;
+      b[0][k] = q0;
+      b[1][k] = q1;
+      b[2][k] = q2;
+      b[3][k] = q3;
+      good[k] = valid;
+    }
+
+    for (int k = 0; k < count; k++) {
+      q[first + k] << b[0][k], b[1][k], b[2][k], b[3][k];
+      ok[first + k] = good[k] != 0.0;
+    }
+  }
+}
+
+}  // namespace StWarp
@@ -0,0 +1,17 @@
+#ifndef STWARP_BATCH_SOLVE_H_
+#define STWARP_BATCH_SOLVE_H_
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+// q[k] = M[k]^-1 p[k] for n symmetric positive definite 4x4 matrices by
+// Cholesky. The factorizations run in structure of arrays lanes, so they
+// vectorize across k. ok[k] is false if a pivot is not positive relative to
+// the diagonal, q[k] is not usable then.
+void choleskySolve4(int n, const Mat4d* M, const Vec4d* p, Vec4d* q,
+                    bool* ok);
+
+}  // namespace StWarp
+
+#endif  // STWARP_BATCH_SOLVE_H_
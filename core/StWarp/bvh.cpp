@@ -0,0 +1,282 @@
+#include "StWarp/bvh.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace StWarp {
+
+namespace {
+
+double boxDistance2(const BVHNode& node, const Vec3d& p) {
+  Vec3d d = (node.box_min - p).cwiseMax(p - node.box_max).cwiseMax(0.0);
+  return d.squaredNorm();
+}
+
+// Solid angle of the triangle (a, b, c) seen from p, Van Oosterom and
+// Strackee 1983.
+double solidAngle(const Vec3d& p, const Vec3d& a, const Vec3d& b,
+                  const Vec3d& c) {
+  Vec3d pa = a - p;
+  Vec3d pb = b - p;
+  Vec3d pc = c - p;
+  double la = pa.norm();
+  double lb = pb.norm();
+  double lc = pc.norm();
+  double det = pa.dot(pb.cross(pc));
+  double div = la * lb * lc + pa.dot(pb) * lc + pb.dot(pc) * la +
+               pc.dot(pa) * lb;
+  return 2.0 * std::atan2(det, div);
+}
+
+}  // namespace
+
+TriangleBVH::TriangleBVH(const MatxXd& verts, const Matx3i& tris)
+    : TriangleBVH(verts, tris,
+                  Vecxi::LinSpaced(tris.rows(), 0, tris.rows() - 1)) {}
+
+TriangleBVH::TriangleBVH(const MatxXd& verts, const Matx3i& tris,
+                         const Vecxi& groups)
+    : verts(verts), tris(tris), groups(groups) {
+  int n_tris = tris.rows();
+  if (n_tris == 0) return;
+  order.resize(n_tris);
+  std::vector<Vec3d> centroids(n_tris);
+  for (int t = 0; t < n_tris; t++) {
+    order[t] = t;
+    centroids[t] = (verts.row(tris(t, 0)) + verts.row(tris(t, 1)) +
+                    verts.row(tris(t, 2)))
+                       .transpose() /
+                   3.0;
+  }
+  nodes.reserve(2 * n_tris);
+  nodes.emplace_back();
+  build(0, 0, n_tris, centroids);
+
+  packets = TriangleSoA(verts, tris, order.data());
+  slot.resize(n_tris);
+  for (int k = 0; k < n_tris; k++) slot[order[k]] = k;
+
+  dipoles.resize(nodes.size());
+  for (size_t n = 0; n < nodes.size(); n++) {
+    BVHDipole& dipole = dipoles[n];
+    Vec3d center = Vec3d::Zero();
+    Vec3d normal = Vec3d::Zero();
+    double area = 0.0;
+    for (int k = nodes[n].first; k < nodes[n].first + nodes[n].count; k++) {
+      int t = order[k];
+      Vec3d a = verts.row(tris(t, 0)).transpose();
+      Vec3d b = verts.row(tris(t, 1)).transpose();
+      Vec3d c = verts.row(tris(t, 2)).transpose();
+      Vec3d n_t = 0.5 * (b - a).cross(c - a);
+      normal += n_t;
+      area += n_t.norm();
+      center += n_t.norm() * centroids[t];
+    }
+    dipole.center = area > 0.0 ? Vec3d(center / area)
+                               : Vec3d(0.5 * (nodes[n].box_min +
+                                              nodes[n].box_max));
+    dipole.normal = normal;
+    dipole.radius = 0.0;
+    for (int k = nodes[n].first; k < nodes[n].first + nodes[n].count; k++) {
+      for (int j = 0; j < 3; j++) {
+        double r = (verts.row(tris(order[k], j)).transpose() - dipole.center)
+                       .norm();
+        dipole.radius = std::max(dipole.radius, r);
+      }
+    }
+  }
+}
+
+void TriangleBVH::build(int node, int first, int count,
+                        std::vector<Vec3d>& centroids) {
+  Vec3d box_min = Vec3d::Constant(std::numeric_limits<double>::max());
+  Vec3d box_max = -box_min;
+  Vec3d c_min = box_min;
+  Vec3d c_max = box_max;
+  for (int k = first; k < first + count; k++) {
+    int t = order[k];
+    for (int j = 0; j < 3; j++) {
+      Vec3d v = verts.row(tris(t, j)).transpose();
+      box_min = box_min.cwiseMin(v);
+      box_max = box_max.cwiseMax(v);
+    }
+    c_min = c_min.cwiseMin(centroids[t]);
+    c_max = c_max.cwiseMax(centroids[t]);
+  }
+  nodes[node].box_min = box_min;
+  nodes[node].box_max = box_max;
+  nodes[node].first = first;
+  nodes[node].count = count;
+  nodes[node].left = -1;
+  if (count <= kLeafSize) return;
+
+  int axis;
+  (c_max - c_min).maxCoeff(&axis);
+  int mid = first + count / 2;
+  std::nth_element(order.begin() + first, order.begin() + mid,
+                   order.begin() + first + count, [&](int a, int b) {
+                     return centroids[a](axis) < centroids[b](axis);
+                   });
+
+  int left = nodes.size();
+  nodes.emplace_back();
+  nodes.emplace_back();
+  nodes[node].left = left;
+  build(left, first, mid - first, centroids);
+  build(left + 1, mid, first + count - mid, centroids);
+}
+
+double TriangleBVH::closest_point(const Vec3d& p, Vec3d& closest_point,
+                                  int& tri) const {
+  double other_bound;
+  return this->closest_point(p, nullptr, 0, closest_point, tri, other_bound);
+}
+
+double TriangleBVH::closest_point(const Vec3d& p, const int* seed, int n_seed,
+                                  Vec3d& closest_point, int& tri,
+                                  double& other_bound) const {
+  tri = -1;
+  other_bound = std::numeric_limits<double>::max();
+  if (nodes.empty()) return other_bound;
+
+  double best2, other2, u, v;
+  int best_slot = query(p, seed, n_seed, 0.0, best2, other2, u, v);
+  tri = order[best_slot];
+  closest_point << packets.ax[best_slot] + u * packets.abx[best_slot] +
+                       v * packets.acx[best_slot],
+      packets.ay[best_slot] + u * packets.aby[best_slot] +
+          v * packets.acy[best_slot],
+      packets.az[best_slot] + u * packets.abz[best_slot] +
+          v * packets.acz[best_slot];
+  other_bound = std::sqrt(other2);
+  return std::sqrt(best2);
+}
+
+double TriangleBVH::distance(const Vec3d& p, const int* seed, int n_seed,
+                             double stop, int& tri,
+                             double& other_bound) const {
+  tri = -1;
+  other_bound = std::numeric_limits<double>::max();
+  if (nodes.empty()) return other_bound;
+
+  double best2, other2, u, v;
+  int best_slot = query(p, seed, n_seed, stop * stop, best2, other2, u, v);
+  tri = order[best_slot];
+  other_bound = std::sqrt(other2);
+  return std::sqrt(best2);
+}
+
+double TriangleBVH::winding_number(const Vec3d& p) const {
+  if (nodes.empty()) return 0.0;
+  auto exact = [&](int first, int count) {
+    double omega = 0.0;
+    for (int k = first; k < first + count; k++) {
+      int t = order[k];
+      omega += solidAngle(p, verts.row(tris(t, 0)).transpose(),
+                          verts.row(tris(t, 1)).transpose(),
+                          verts.row(tris(t, 2)).transpose());
+    }
+    return omega;
+  };
+  if ((int)order.size() <= kBruteForceSize)
+    return exact(0, order.size()) / (4.0 * M_PI);
+
+  double omega = 0.0;
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    int n = stack[--top];
+    const BVHNode& node = nodes[n];
+    const BVHDipole& dipole = dipoles[n];
+    Vec3d r = dipole.center - p;
+    double dist = r.norm();
+    if (dist > kWindingBeta * dipole.radius) {
+      omega += r.dot(dipole.normal) / (dist * dist * dist);
+    } else if (node.left < 0) {
+      omega += exact(node.first, node.count);
+    } else {
+      stack[top++] = node.left;
+      stack[top++] = node.left + 1;
+    }
+  }
+  return omega / (4.0 * M_PI);
+}
+
+int TriangleBVH::query(const Vec3d& p, const int* seed, int n_seed,
+                       double stop2, double& best2, double& other2, double& u,
+                       double& v) const {
+  best2 = std::numeric_limits<double>::max();
+  other2 = best2;
+  int best_group = -1;
+  int best_slot = -1;
+
+  double d2[kBruteForceSize];
+  double lane_u[kBruteForceSize];
+  double lane_v[kBruteForceSize];
+  // packet distances to slots [first, first + count)
+  auto visit = [&](int first, int count) {
+    pointTrianglesDistance(packets, first, count, p, d2, lane_u, lane_v);
+    for (int k = 0; k < count; k++) {
+      int g = groups[order[first + k]];
+      if (g == best_group) {
+        if (d2[k] >= best2) continue;
+      } else if (d2[k] < best2) {
+        other2 = best2;
+        best_group = g;
+      } else {
+        other2 = std::min(other2, d2[k]);
+        continue;
+      }
+      best2 = d2[k];
+      best_slot = first + k;
+      u = lane_u[k];
+      v = lane_v[k];
+    }
+  };
+
+  for (int k = 0; k < n_seed; k++) visit(slot[seed[k]], 1);
+
+  const double cap2 = kOtherCap * kOtherCap;
+  if ((int)order.size() <= kBruteForceSize) {
+    visit(0, order.size());
+  } else if (best2 > stop2) {
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const BVHNode& node = nodes[stack[--top]];
+      if (boxDistance2(node, p) >= std::min(other2, cap2 * best2)) continue;
+      if (node.left < 0) {
+        visit(node.first, node.count);
+        if (best2 <= stop2) {
+          // close enough, the subtrees left on the stack were not checked
+          other2 = 0.0;
+          break;
+        }
+        continue;
+      }
+      // visit the nearer child first
+      double d_left = boxDistance2(nodes[node.left], p);
+      double d_right = boxDistance2(nodes[node.left + 1], p);
+      if (d_left < d_right) {
+        stack[top++] = node.left + 1;
+        stack[top++] = node.left;
+      } else {
+        stack[top++] = node.left;
+        stack[top++] = node.left + 1;
+      }
+    }
+  } else {
+    // a seed is already close enough
+    other2 = 0.0;
+  }
+  // pruned subtrees are at least this far away
+  other2 = std::min(other2, cap2 * best2);
+  return best_slot;
+}
+
+}  // namespace StWarp
@@ -0,0 +1,89 @@
+#ifndef STWARP_BVH_H_
+#define STWARP_BVH_H_
+
+#include <vector>
+
+#include "StWarp/type.h"
+#include "StWarp/distance_kernels.h"
+
+namespace StWarp {
+
+struct BVHNode {
+  Vec3d box_min;
+  Vec3d box_max;
+  // inner node: children are left and left + 1, leaf: triangles
+  // [first, first + count) of TriangleBVH::order
+  int left;
+  int first;
+  int count;
+};
+
+// Far field of the triangles below a BVH node for winding numbers: the area
+// weighted normal placed at the area weighted center, radius bounds the
+// triangles around the center.
+struct BVHDipole {
+  Vec3d center;
+  Vec3d normal;
+  double radius;
+};
+
+// Bounding volume hierarchy over triangles for closest point queries.
+// Triangles can be grouped, e.g. the two triangles of a quad face.
+struct TriangleBVH {
+  // one packet of the distance kernels per leaf
+  static const int kLeafSize = 8;
+  // up to this many triangles a packet scan of all of them beats traversal
+  static const int kBruteForceSize = 64;
+  // other_bound is only refined up to this multiple of the closest distance
+  static constexpr double kOtherCap = 4.0;
+  // nodes farther than this multiple of their radius use the dipole
+  static constexpr double kWindingBeta = 2.0;
+
+  MatxXd verts;
+  Matx3i tris;
+  Vecxi groups;
+  std::vector<BVHNode> nodes;
+  std::vector<int> order;
+  // triangles in the order of the leaves, slot[t] is the position of t
+  TriangleSoA packets;
+  std::vector<int> slot;
+  std::vector<BVHDipole> dipoles;
+
+  TriangleBVH() {}
+  TriangleBVH(const MatxXd& verts, const Matx3i& tris);
+  TriangleBVH(const MatxXd& verts, const Matx3i& tris, const Vecxi& groups);
+
+  // Distance from p to the closest triangle, closest_point and tri are set to
+  // the closest point and its triangle row in tris.
+  double closest_point(const Vec3d& p, Vec3d& closest_point, int& tri) const;
+
+  // Same query seeded with n_seed triangles known to be close, e.g. the
+  // closest face of the previous walk step, so the traversal is pruned from
+  // the start. other_bound is set to a lower bound of the distance to every
+  // triangle outside the group of tri.
+  double closest_point(const Vec3d& p, const int* seed, int n_seed,
+                       Vec3d& closest_point, int& tri,
+                       double& other_bound) const;
+
+  // Generalized winding number of the triangles at p, about 1 inside and 0
+  // outside a closed mesh with outward normals. Exact for small meshes, far
+  // nodes use the dipole approximation of Barill et al. 2018.
+  double winding_number(const Vec3d& p) const;
+
+  // Distance only version of the seeded query. The traversal stops as soon
+  // as a triangle within stop is found, that triangle is returned in tri and
+  // other_bound is 0 in that case.
+  double distance(const Vec3d& p, const int* seed, int n_seed, double stop,
+                  int& tri, double& other_bound) const;
+
+ private:
+  void build(int node, int first, int count, std::vector<Vec3d>& centroids);
+  // shared traversal, returns the slot of the closest triangle and its
+  // (u, v) in the packets
+  int query(const Vec3d& p, const int* seed, int n_seed, double stop2,
+            double& best2, double& other2, double& u, double& v) const;
+};
+
+}  // namespace StWarp
+
+#endif  // STWARP_BVH_H_
@@ -0,0 +1,164 @@
+#include "StWarp/cage_face.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "StWarp/cpu_dispatch.h"
+#include "StWarp/distance_kernels.h"
+
+namespace StWarp {
+
+namespace {
+
+FaceTriangle setupFaceTriangle(const Vec3d& a, const Vec3d& b,
+                               const Vec3d& c) {
+  FaceTriangle tri;
+  tri.a = a;
+  tri.ab = b - a;
+  tri.ac = c - a;
+  tri.d00 = tri.ab.dot(tri.ab);
+  tri.d01 = tri.ab.dot(tri.ac);
+  tri.d11 = tri.ac.dot(tri.ac);
+  tri.inv_denom = safeInverse(tri.d00 * tri.d11 - tri.d01 * tri.d01);
+  tri.inv_d00 = safeInverse(tri.d00);
+  tri.inv_d11 = safeInverse(tri.d11);
+  tri.inv_dbc = safeInverse((c - b).squaredNorm());
+  return tri;
+}
+
+}  // namespace
+
+CageFace setupCageFace(const MatxXd& cage_verts, const int* verts,
+                       int n_verts) {
+  CageFace face;
+  face.n_verts = n_verts;
+  Vec3d p[4];
+  for (int k = 0; k < 4; k++) {
+    face.verts[k] = k < n_verts ? verts[k] : verts[0];
+    p[k] = cage_verts.row(face.verts[k]).transpose();
+  }
+  face.tris[0] = setupFaceTriangle(p[0], p[1], p[2]);
+  if (n_verts == 4) {
+    face.n_tris = 2;
+    face.tris[1] = setupFaceTriangle(p[0], p[2], p[3]);
+    face.quad = setupBilinearQuad(p[0], p[1], p[2], p[3]);
+  } else {
+    face.n_tris = 1;
+    face.tris[1] = face.tris[0];
+  }
+  return face;
+}
+
+double faceDistance(const CageFace& face, const Vec3d& p,
+                    Vec3d& closest_point) {
+  double best2 = std::numeric_limits<double>::max();
+  for (int k = 0; k < face.n_tris; k++) {
+    const FaceTriangle& t = face.tris[k];
+    double d2, u, v;
+    triangleLane(p(0) - t.a(0), p(1) - t.a(1), p(2) - t.a(2), t.ab(0),
+                 t.ab(1), t.ab(2), t.ac(0), t.ac(1), t.ac(2), t.d00, t.d01,
+                 t.d11, t.inv_denom, t.inv_d00, t.inv_d11, t.inv_dbc, d2, u,
+                 v);
+    if (d2 < best2) {
+      best2 = d2;
+      closest_point = t.a + u * t.ab + v * t.ac;
+    }
+  }
+  return std::sqrt(best2);
+}
+
+double faceDistance(const CageFace& face, const Vec3d& p) {
+  double best2 = std::numeric_limits<double>::max();
+  for (int k = 0; k < face.n_tris; k++) {
+    const FaceTriangle& t = face.tris[k];
+    double d2, u, v;
+    triangleLane(p(0) - t.a(0), p(1) - t.a(1), p(2) - t.a(2), t.ab(0),
+                 t.ab(1), t.ab(2), t.ac(0), t.ac(1), t.ac(2), t.d00, t.d01,
+                 t.d11, t.inv_denom, t.inv_d00, t.inv_d11, t.inv_dbc, d2, u,
+                 v);
+    best2 = std::min(best2, d2);
+  }
+  return std::sqrt(best2);
+}
+
+Vec4d faceWeights(const CageFace& face, const Vec3d& p) {
+  if (face.n_verts == 4) return computeBilinearCoordinates(p, face.quad);
+
+  // same as computeBarycentricCoordinates, zero for degenerate triangles
+  const FaceTriangle& t = face.tris[0];
+  Vec4d w = Vec4d::Zero();
+  if (t.inv_denom == 0.0) return w;
+  Vec3d ap = p - t.a;
+  double d20 = ap.dot(t.ab);
+  double d21 = ap.dot(t.ac);
+  w(1) = (t.d11 * d20 - t.d01 * d21) * t.inv_denom;
+  w(2) = (t.d00 * d21 - t.d01 * d20) * t.inv_denom;
+  w(0) = 1.0 - w(1) - w(2);
+  return w;
+}
+
+STWARP_KERNEL
+void closestFaceWeights(const CageFace& face, int n, const double* px,
+                        const double* py, const double* pz, double* w) {
+  // points per pass, the scratch lanes stay on the stack
+  const int kChunk = 128;
+  alignas(64) double best[kChunk], cx[kChunk], cy[kChunk], cz[kChunk];
+  alignas(64) double u[kChunk], v[kChunk];
+  for (int first = 0; first < n; first += kChunk) {
+    int count = std::min(kChunk, n - first);
+    const double* x = px + first;
+    const double* y = py + first;
+    const double* z = pz + first;
+    double* wk = w + 4 * first;
+    std::fill(best, best + count, std::numeric_limits<double>::max());
+
+    // closest point over the triangles of the face
+    for (int t = 0; t < face.n_tris; t++) {
+      const FaceTriangle& tri = face.tris[t];
+      const double ax = tri.a(0), ay = tri.a(1), az = tri.a(2);
+      const double abx = tri.ab(0), aby = tri.ab(1), abz = tri.ab(2);
+      const double acx = tri.ac(0), acy = tri.ac(1), acz = tri.ac(2);
+#pragma omp simd
+      for (int k = 0; k < count; k++) {
+        double d2, s, r;
+        triangleLane(x[k] - ax, y[k] - ay, z[k] - az, abx, aby, abz, acx, acy,
+                     acz, tri.d00, tri.d01, tri.d11, tri.inv_denom,
+                     tri.inv_d00, tri.inv_d11, tri.inv_dbc, d2, s, r);
+        bool closer = d2 < best[k];
+        best[k] = closer ? d2 : best[k];
+        cx[k] = closer ? ax + s * abx + r * acx : cx[k];
+        cy[k] = closer ? ay + s * aby + r * acy : cy[k];
+        cz[k] = closer ? az + s * abz + r * acz : cz[k];
+        u[k] = closer ? s : u[k];
+        v[k] = closer ? r : v[k];
+      }
+    }
+
+    if (face.n_verts == 4) {
+      computeBilinearCoordinates(face.quad, count, cx, cy, cz, u, v);
+#pragma omp simd
+      for (int k = 0; k < count; k++) {
+        wk[4 * k] = (1.0 - u[k]) * (1.0 - v[k]);
+        wk[4 * k + 1] = u[k] * (1.0 - v[k]);
+        wk[4 * k + 2] = u[k] * v[k];
+        wk[4 * k + 3] = (1.0 - u[k]) * v[k];
+      }
+    } else {
+      // (u, v) of the closest point are its barycentric coordinates, zero
+      // for degenerate triangles like faceWeights
+      double valid = face.tris[0].inv_denom == 0.0 ? 0.0 : 1.0;
+#pragma omp simd
+      for (int k = 0; k < count; k++) {
+        wk[4 * k] = valid * (1.0 - u[k] - v[k]);
+        wk[4 * k + 1] = valid * u[k];
+        wk[4 * k + 2] = valid * v[k];
+        wk[4 * k + 3] = 0.0;
+      }
+    }
+  }
+}
+
+}  // namespace StWarp
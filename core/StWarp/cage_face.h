@@ -0,0 +1,53 @@
+#ifndef STWARP_CAGE_FACE_H_
+#define STWARP_CAGE_FACE_H_
+
+#include <vector>
+
+#include "StWarp/type.h"
+#include "StWarp/barycentric.h"
+
+namespace StWarp {
+
+// One triangle with the terms of triangleLane, as in TriangleSoA.
+struct FaceTriangle {
+  Vec3d a, ab, ac;
+  double d00, d01, d11;
+  double inv_denom, inv_d00, inv_d11, inv_dbc;
+};
+
+// Geometry of one cage face precomputed for the walks, so the inner loop
+// reads one record instead of gathering rows of cage_verts. Quads are split
+// along the 0-2 diagonal like in the BVH.
+struct alignas(64) CageFace {
+  int n_verts;
+  int verts[4];
+  int n_tris;
+  FaceTriangle tris[2];
+  // quads only
+  BilinearQuad quad;
+};
+
+using CageFaces = std::vector<CageFace>;
+
+// verts: n_verts (3 or 4) cage vertex indices
+CageFace setupCageFace(const MatxXd& cage_verts, const int* verts,
+                       int n_verts);
+
+// Distance from p to the face, closest_point is set to its closest point.
+double faceDistance(const CageFace& face, const Vec3d& p,
+                    Vec3d& closest_point);
+// Same without the closest point.
+double faceDistance(const CageFace& face, const Vec3d& p);
+
+// Weights of the face vertices at p on the face, barycentric for triangles
+// and bilinear for quads. The unused fourth weight of triangles is zero.
+Vec4d faceWeights(const CageFace& face, const Vec3d& p);
+
+// Batched faceWeights of the closest points on the face to n points. The
+// weights of point k are w[4 * k, 4 * k + 4).
+void closestFaceWeights(const CageFace& face, int n, const double* px,
+                        const double* py, const double* pz, double* w);
+
+}  // namespace StWarp
+
+#endif  // STWARP_CAGE_FACE_H_
@@ -0,0 +1,16 @@
+#include "StWarp/cpu_dispatch.h"
+
+namespace StWarp {
+
+const char* kernelTarget() {
+#if STWARP_KERNEL_CLONES
+  // the order in which the ifunc resolvers pick the clones
+  if (__builtin_cpu_supports("avx512f")) return "avx512f";
+  if (__builtin_cpu_supports("avx2")) return "avx2";
+  return "baseline";
+#else
+  return "compile flags";
+#endif
+}
+
+}  // namespace StWarp
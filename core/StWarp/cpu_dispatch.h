@@ -0,0 +1,28 @@
+#ifndef STWARP_CPU_DISPATCH_H_
+#define STWARP_CPU_DISPATCH_H_
+
+// STWARP_KERNEL marks the hot loops. With STWARP_CPU_DISPATCH they are
+// compiled for AVX-512, AVX2 and the SSE4.2 baseline of the build, and the
+// dynamic loader binds the best one the cpu supports, so one plugin runs on
+// every machine and still uses the widest vectors it has. Clones need
+// ifunc, i.e. GCC or clang 14+ on x86-64 ELF. Elsewhere the kernels are
+// only built for the compile flags.
+#if defined(STWARP_CPU_DISPATCH) && defined(__x86_64__) && \
+    defined(__ELF__) && defined(__GNUC__) &&               \
+    !(defined(__clang__) && __clang_major__ < 14)
+#define STWARP_KERNEL_CLONES 1
+#define STWARP_KERNEL \
+  __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define STWARP_KERNEL_CLONES 0
+#define STWARP_KERNEL
+#endif
+
+namespace StWarp {
+
+// Instruction set the STWARP_KERNEL loops run with on this cpu.
+const char* kernelTarget();
+
+}  // namespace StWarp
+
+#endif  // STWARP_CPU_DISPATCH_H_
@@ -10,10 +10,51 @@
 #include <maya/MGlobal.h>
 
 #include <sstream>
+#include <vector>
+
+#include "StWarp/cpu_dispatch.h"
+#include "StWarp/parallel.h"
+
+namespace {
+
+// Below this many multiply adds, points times cage points, the blend is
+// not worth waking the threads.
+const size_t kParallelBlendWork = 1 << 20;
+
+// (x, y, z) = sum of w[i] * (cx[i], cy[i], cz[i]) over the n cage points.
+// Summed in kBlendLanes partial sums of fixed cage points, added up in a
+// fixed order, so every clone gives the same points whatever its vector
+// width.
+const int kBlendLanes = 4;
+
+STWARP_KERNEL
+void blendPoint(int n, const double* w, const double* cx, const double* cy,
+                const double* cz, double& x, double& y, double& z) {
+  double sx[kBlendLanes] = {}, sy[kBlendLanes] = {}, sz[kBlendLanes] = {};
+  int i = 0;
+  for (; i + kBlendLanes <= n; i += kBlendLanes) {
+    for (int l = 0; l < kBlendLanes; l++) {
+      sx[l] += w[i + l] * cx[i + l];
+      sy[l] += w[i + l] * cy[i + l];
+      sz[l] += w[i + l] * cz[i + l];
+    }
+  }
+  for (int l = 0; i < n; i++, l++) {
+    sx[l] += w[i] * cx[i];
+    sy[l] += w[i] * cy[i];
+    sz[l] += w[i] * cz[i];
+  }
+  x = (sx[0] + sx[1]) + (sx[2] + sx[3]);
+  y = (sy[0] + sy[1]) + (sy[2] + sy[3]);
+  z = (sz[0] + sz[1]) + (sz[2] + sz[3]);
+}
+
+}  // namespace
 
 MTypeId MyTypedDeformer::id(0x0011FFAC);  // Replace with a unique ID
 MObject MyTypedDeformer::aCageMesh;
 MObject MyTypedDeformer::aStWeights;
+MObject MyTypedDeformer::aStExterior;
 
 void* MyTypedDeformer::creator() { return new MyTypedDeformer(); }
 
@@ -41,6 +82,15 @@ MStatus MyTypedDeformer::initialize() {
 
   addAttribute(aStWeights);
 
+  MFnTypedAttribute exAttr;
+
+  aStExterior = exAttr.create("stexterior", "stex", MFnData::kIntArray);
+  exAttr.setStorable(true);
+  exAttr.setReadable(true);
+  exAttr.setWritable(true);
+
+  addAttribute(aStExterior);
+
   return MS::kSuccess;
 }
 
@@ -63,28 +113,53 @@ MStatus MyTypedDeformer::deform(MDataBlock& dataBlock, MItGeometry& iter,
   MDoubleArray weightsArray = weightsArrayData.array();
 
   unsigned int cage_points_count = cagePoints.length();
+  // cage points in structure of arrays layout for blendPoint
+  std::vector<double> cage_x(cage_points_count);
+  std::vector<double> cage_y(cage_points_count);
+  std::vector<double> cage_z(cage_points_count);
+  for (unsigned int i = 0; i < cage_points_count; i++) {
+    cage_x[i] = cagePoints[i].x;
+    cage_y[i] = cagePoints[i].y;
+    cage_z[i] = cagePoints[i].z;
+  }
+  const double* weights = weightsArray.length() > 0 ? &weightsArray[0]
+                                                    : nullptr;
 
   MDataHandle envData = dataBlock.inputValue(envelope, &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
   float env = envData.asFloat();
 
-  for (; !iter.isDone(); iter.next()) {
-    MPoint pt = iter.position();
+  MPointArray points;
+  iter.allPositions(points, MSpace::kWorld);
+  std::vector<int> indices;
+  indices.reserve(points.length());
+  for (; !iter.isDone(); iter.next()) indices.push_back(iter.index());
 
-    int idx = iter.index();
-    MPoint orinPoint = iter.position(MSpace::kWorld);
+  auto blend = [&](int k) {
+    int idx = indices[k];
+    MPoint orinPoint = points[k];
 
     MPoint interp(0, 0, 0);
-
-    for (int i = 0; i < cage_points_count; i++) {
-      MPoint cagePoint = cagePoints[i];
-      double weight = weightsArray[idx * cage_points_count + i];
-      interp += cagePoint * weight;
-    }
-
-    MPoint final_point = orinPoint + (interp - orinPoint) * env;
-    iter.setPosition(final_point);
+    blendPoint(cage_points_count, weights + (size_t)idx * cage_points_count,
+               cage_x.data(), cage_y.data(), cage_z.data(), interp.x,
+               interp.y, interp.z);
+
+    points[k] = orinPoint + (interp - orinPoint) * env;
+  };
+  // Large meshes are blended on the solver's threads. On a thread of
+  // Maya's parallel evaluation only the tbb backend shares the host's
+  // threads, openmp would start a team of every cpu per deformer and the
+  // pool runs one deformer at a time, so the blend stays on this thread.
+  bool parallel =
+      (size_t)points.length() * cage_points_count >= kParallelBlendWork &&
+      (StWarp::parallelBackend() == StWarp::ParallelBackend::kTBB ||
+       !StWarp::inHostThread());
+  if (parallel) {
+    StWarp::parallelFor(0, (int)points.length(), blend);
+  } else {
+    for (int k = 0; k < (int)points.length(); k++) blend(k);
   }
+  iter.setAllPositions(points);
 
   return MS::kSuccess;
 }
\ No newline at end of file
@@ -21,6 +21,7 @@ class MyTypedDeformer : public MPxDeformerNode {
   static MTypeId id;          // Unique Node ID
   static MObject aCageMesh;   // Mesh attribute for cage
   static MObject aStWeights;  // Weights attribute for cage
+  static MObject aStExterior;  // 1 for vertices bound outside the cage
 };
 
 #endif  // STWARP_DEFORM_NODE_H
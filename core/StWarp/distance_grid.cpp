@@ -0,0 +1,112 @@
+#include "StWarp/distance_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include "StWarp/parallel.h"
+
+namespace StWarp {
+
+namespace {
+
+size_t hashCage(const TriangleBVH& bvh, int resolution) {
+  size_t h = std::hash<int>()(resolution);
+  auto mix = [&h](size_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  };
+  for (int i = 0; i < bvh.verts.size(); i++) {
+    double v = bvh.verts.data()[i];
+    unsigned long long bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    mix(bits);
+  }
+  for (int i = 0; i < bvh.tris.size(); i++) mix(bvh.tris.data()[i]);
+  return h;
+}
+
+}  // namespace
+
+DistanceGrid::DistanceGrid(const TriangleBVH& bvh, int resolution) {
+  Vec3d box_min = bvh.verts.colwise().minCoeff().transpose();
+  Vec3d box_max = bvh.verts.colwise().maxCoeff().transpose();
+  resolution = std::max(resolution, 1);
+  cell = (box_max - box_min).maxCoeff() / resolution;
+  if (cell <= 0.0) cell = 1.0;
+  diagonal = std::sqrt(3.0) * cell;
+  origin = box_min;
+  for (int a = 0; a < 3; a++)
+    dims(a) = (int)std::ceil((box_max(a) - box_min(a)) / cell) + 1;
+  dims = dims.cwiseMax(2);
+
+  int n_nodes = dims(0) * dims(1) * dims(2);
+  values.resize(n_nodes);
+  parallelFor(0, n_nodes, [&](int n) {
+    int x = n % dims(0);
+    int y = (n / dims(0)) % dims(1);
+    int z = n / (dims(0) * dims(1));
+    Vec3d p = origin + cell * Vec3d(x, y, z);
+    Vec3d cp;
+    int tri;
+    double d = bvh.closest_point(p, cp, tri);
+    float f = (float)d;
+    if (f > d) f = std::nextafter(f, 0.0f);
+    values[n] = f;
+  });
+}
+
+double DistanceGrid::lower_bound(const Vec3d& p) const {
+  Vec3d q = (p - origin) / cell;
+  int x = (int)std::floor(q(0));
+  int y = (int)std::floor(q(1));
+  int z = (int)std::floor(q(2));
+  if (x < 0 || y < 0 || z < 0 || x >= dims(0) - 1 || y >= dims(1) - 1 ||
+      z >= dims(2) - 1)
+    return -1.0;
+  double u = q(0) - x;
+  double v = q(1) - y;
+  double w = q(2) - z;
+  const int sy = dims(0);
+  const int sz = dims(0) * dims(1);
+  const float* c = &values[x + y * sy + z * sz];
+  double c00 = c[0] + u * (c[1] - c[0]);
+  double c10 = c[sy] + u * (c[sy + 1] - c[sy]);
+  double c01 = c[sz] + u * (c[sz + 1] - c[sz]);
+  double c11 = c[sy + sz] + u * (c[sy + sz + 1] - c[sy + sz]);
+  double c0 = c00 + v * (c10 - c00);
+  double c1 = c01 + v * (c11 - c01);
+  return c0 + w * (c1 - c0) - diagonal;
+}
+
+std::shared_ptr<const DistanceGrid> cachedDistanceGrid(const TriangleBVH& bvh,
+                                                       int resolution) {
+  // a few recently used cages are enough for the bind-many-meshes case,
+  // recent is ordered from least to most recently used
+  static const size_t kCacheSize = 4;
+  static std::mutex mutex;
+  static std::map<size_t, std::shared_ptr<const DistanceGrid>> cache;
+  static std::vector<size_t> recent;
+
+  size_t key = hashCage(bvh, resolution);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = cache.find(key);
+  if (it != cache.end()) {
+    auto used = std::find(recent.begin(), recent.end(), key);
+    std::rotate(used, used + 1, recent.end());
+    return it->second;
+  }
+
+  auto grid = std::make_shared<const DistanceGrid>(bvh, resolution);
+  cache[key] = grid;
+  recent.push_back(key);
+  if (recent.size() > kCacheSize) {
+    cache.erase(recent.front());
+    recent.erase(recent.begin());
+  }
+  return grid;
+}
+
+}  // namespace StWarp
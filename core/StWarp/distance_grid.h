@@ -0,0 +1,39 @@
+#ifndef STWARP_DISTANCE_GRID_H_
+#define STWARP_DISTANCE_GRID_H_
+
+#include <memory>
+#include <vector>
+
+#include "StWarp/type.h"
+#include "StWarp/bvh.h"
+
+namespace StWarp {
+
+// Unsigned distance to the cage sampled at the nodes of a uniform grid over
+// the cage bounding box. Values are rounded down to float.
+struct DistanceGrid {
+  Vec3d origin;
+  double cell;
+  // length of the cell diagonal
+  double diagonal;
+  // number of nodes along each axis
+  Vec3i dims;
+  std::vector<float> values;
+
+  // resolution: number of cells along the longest side of the bounding box
+  DistanceGrid(const TriangleBVH& bvh, int resolution);
+
+  // Lower bound of the distance to the cage at p: trilinear interpolation of
+  // the node distances minus the cell diagonal, as the distance is
+  // 1-Lipschitz. Negative outside the grid.
+  double lower_bound(const Vec3d& p) const;
+};
+
+// Grid of the cage triangles in bvh, shared with earlier calls on the same
+// cage and resolution, e.g. when several meshes are bound to one cage.
+std::shared_ptr<const DistanceGrid> cachedDistanceGrid(const TriangleBVH& bvh,
+                                                       int resolution);
+
+}  // namespace StWarp
+
+#endif  // STWARP_DISTANCE_GRID_H_
@@ -0,0 +1,65 @@
+#include "StWarp/distance_kernels.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "StWarp/cpu_dispatch.h"
+
+namespace StWarp {
+
+TriangleSoA::TriangleSoA(const MatxXd& verts, const Matx3i& tris,
+                         const int* order)
+    : size(tris.rows()) {
+  for (AlignedVecd* a : {&ax, &ay, &az, &abx, &aby, &abz, &acx, &acy, &acz,
+                         &d00, &d01, &d11, &inv_denom, &inv_d00, &inv_d11,
+                         &inv_dbc})
+    a->resize(size);
+  for (int k = 0; k < size; k++) {
+    int t = order[k];
+    Vec3d a = verts.row(tris(t, 0)).transpose();
+    Vec3d ab = verts.row(tris(t, 1)).transpose() - a;
+    Vec3d ac = verts.row(tris(t, 2)).transpose() - a;
+    ax[k] = a(0);
+    ay[k] = a(1);
+    az[k] = a(2);
+    abx[k] = ab(0);
+    aby[k] = ab(1);
+    abz[k] = ab(2);
+    acx[k] = ac(0);
+    acy[k] = ac(1);
+    acz[k] = ac(2);
+    d00[k] = ab.dot(ab);
+    d01[k] = ab.dot(ac);
+    d11[k] = ac.dot(ac);
+    inv_denom[k] = safeInverse(d00[k] * d11[k] - d01[k] * d01[k]);
+    inv_d00[k] = safeInverse(d00[k]);
+    inv_d11[k] = safeInverse(d11[k]);
+    inv_dbc[k] = safeInverse((ac - ab).squaredNorm());
+  }
+}
+
+STWARP_KERNEL
+void pointTrianglesDistance(const TriangleSoA& tris, int first, int count,
+                            const Vec3d& p, double* d2, double* u, double* v) {
+  const double px = p(0), py = p(1), pz = p(2);
+  const double *ax = &tris.ax[first], *ay = &tris.ay[first],
+               *az = &tris.az[first];
+  const double *abx = &tris.abx[first], *aby = &tris.aby[first],
+               *abz = &tris.abz[first];
+  const double *acx = &tris.acx[first], *acy = &tris.acy[first],
+               *acz = &tris.acz[first];
+  const double *d00 = &tris.d00[first], *d01 = &tris.d01[first],
+               *d11 = &tris.d11[first];
+  const double *inv_denom = &tris.inv_denom[first],
+               *inv_d00 = &tris.inv_d00[first],
+               *inv_d11 = &tris.inv_d11[first],
+               *inv_dbc = &tris.inv_dbc[first];
+#pragma omp simd
+  for (int k = 0; k < count; k++) {
+    triangleLane(px - ax[k], py - ay[k], pz - az[k], abx[k], aby[k], abz[k],
+                 acx[k], acy[k], acz[k], d00[k], d01[k], d11[k], inv_denom[k],
+                 inv_d00[k], inv_d11[k], inv_dbc[k], d2[k], u[k], v[k]);
+  }
+}
+
+}  // namespace StWarp
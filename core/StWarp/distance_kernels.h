@@ -0,0 +1,115 @@
+#ifndef STWARP_DISTANCE_KERNELS_H_
+#define STWARP_DISTANCE_KERNELS_H_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+template <typename Scalar>
+inline Scalar clamp01(Scalar x) {
+  return std::min(std::max(x, Scalar(0)), Scalar(1));
+}
+
+inline double safeInverse(double x) { return x > 0.0 ? 1.0 / x : 0.0; }
+
+// Distance from (apx, apy, apz) = p - a to one triangle. Candidates are the
+// interior projection and the three clamped edge projections, the smallest
+// one wins. A degenerate triangle only yields the edge candidates, plus a
+// itself which is also on the triangle. Scalar is double or float.
+template <typename Scalar>
+inline void triangleLane(Scalar apx, Scalar apy, Scalar apz, Scalar abx,
+                         Scalar aby, Scalar abz, Scalar acx, Scalar acy,
+                         Scalar acz, Scalar d00, Scalar d01, Scalar d11,
+                         Scalar inv_denom, Scalar inv_d00, Scalar inv_d11,
+                         Scalar inv_dbc, Scalar& d2, Scalar& u, Scalar& v) {
+  Scalar e0 = apx * abx + apy * aby + apz * abz;
+  Scalar e1 = apx * acx + apy * acy + apz * acz;
+
+  Scalar s = (d11 * e0 - d01 * e1) * inv_denom;
+  Scalar t = (d00 * e1 - d01 * e0) * inv_denom;
+  Scalar qx = apx - s * abx - t * acx;
+  Scalar qy = apy - s * aby - t * acy;
+  Scalar qz = apz - s * abz - t * acz;
+  bool inside = s >= Scalar(0) && t >= Scalar(0) && s + t <= Scalar(1);
+  Scalar best = inside ? qx * qx + qy * qy + qz * qz
+                       : std::numeric_limits<Scalar>::max();
+  Scalar bu = s;
+  Scalar bv = t;
+
+  // edge ab
+  Scalar t0 = clamp01(e0 * inv_d00);
+  qx = apx - t0 * abx;
+  qy = apy - t0 * aby;
+  qz = apz - t0 * abz;
+  Scalar d = qx * qx + qy * qy + qz * qz;
+  bool closer = d < best;
+  best = closer ? d : best;
+  bu = closer ? t0 : bu;
+  bv = closer ? Scalar(0) : bv;
+
+  // edge ac
+  Scalar t1 = clamp01(e1 * inv_d11);
+  qx = apx - t1 * acx;
+  qy = apy - t1 * acy;
+  qz = apz - t1 * acz;
+  d = qx * qx + qy * qy + qz * qz;
+  closer = d < best;
+  best = closer ? d : best;
+  bu = closer ? Scalar(0) : bu;
+  bv = closer ? t1 : bv;
+
+  // edge bc, bc = ac - ab and p - b = ap - ab
+  Scalar bcx = acx - abx;
+  Scalar bcy = acy - aby;
+  Scalar bcz = acz - abz;
+  Scalar bpx = apx - abx;
+  Scalar bpy = apy - aby;
+  Scalar bpz = apz - abz;
+  Scalar t2 = clamp01((bpx * bcx + bpy * bcy + bpz * bcz) * inv_dbc);
+  qx = bpx - t2 * bcx;
+  qy = bpy - t2 * bcy;
+  qz = bpz - t2 * bcz;
+  d = qx * qx + qy * qy + qz * qz;
+  closer = d < best;
+  best = closer ? d : best;
+  bu = closer ? Scalar(1) - t2 : bu;
+  bv = closer ? t2 : bv;
+
+  d2 = best;
+  u = bu;
+  v = bv;
+}
+
+using AlignedVecd = std::vector<double, Eigen::aligned_allocator<double>>;
+
+// Triangles in structure of arrays layout for the packet kernel below. Per
+// triangle (a, b, c) it keeps a, the edges ab and ac and the reciprocals
+// used by the projections, so the kernel is branch free over the lanes.
+struct TriangleSoA {
+  int size = 0;
+  AlignedVecd ax, ay, az;
+  AlignedVecd abx, aby, abz;
+  AlignedVecd acx, acy, acz;
+  AlignedVecd d00, d01, d11;
+  AlignedVecd inv_denom, inv_d00, inv_d11, inv_dbc;
+
+  TriangleSoA() {}
+  // rows of tris in the given order
+  TriangleSoA(const MatxXd& verts, const Matx3i& tris, const int* order);
+};
+
+// Squared distance from p to triangles [first, first + count) of tris. The
+// closest point on triangle k is a + u[k] * ab + v[k] * ac, i.e. its
+// barycentric coordinates are (1 - u[k] - v[k], u[k], v[k]).
+void pointTrianglesDistance(const TriangleSoA& tris, int first, int count,
+                            const Vec3d& p, double* d2, double* u, double* v);
+
+}  // namespace StWarp
+
+#endif  // STWARP_DISTANCE_KERNELS_H_
@@ -0,0 +1,48 @@
+#include "StWarp/ordering.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "StWarp/parallel.h"
+
+namespace StWarp {
+
+namespace {
+
+// spreads the lower 21 bits of x to every third bit
+uint64_t spreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+}  // namespace
+
+Vecxi mortonOrder(const MatxXd& points) {
+  int n_points = points.rows();
+  Vecxi order(n_points);
+  if (n_points == 0) return order;
+
+  Vec3d box_min = points.colwise().minCoeff().transpose();
+  Vec3d extent = points.colwise().maxCoeff().transpose() - box_min;
+  double scale = extent.maxCoeff() > 0.0 ? 0x1fffff / extent.maxCoeff() : 0.0;
+  std::vector<std::pair<uint64_t, int>> codes(n_points);
+  parallelFor(0, n_points, [&](int i) {
+    Vec3d c = (points.row(i).transpose() - box_min) * scale;
+    codes[i].first = spreadBits((uint64_t)c(0)) |
+                     spreadBits((uint64_t)c(1)) << 1 |
+                     spreadBits((uint64_t)c(2)) << 2;
+    codes[i].second = i;
+  });
+  std::sort(codes.begin(), codes.end());
+  for (int k = 0; k < n_points; k++) order[k] = codes[k].second;
+  return order;
+}
+
+}  // namespace StWarp
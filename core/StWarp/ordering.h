@@ -0,0 +1,15 @@
+#ifndef STWARP_ORDERING_H_
+#define STWARP_ORDERING_H_
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+// Permutation of points along a Morton curve over their bounding box,
+// order[k] is the point at position k. Points close in the order are close
+// in space.
+Vecxi mortonOrder(const MatxXd& points);
+
+}  // namespace StWarp
+
+#endif  // STWARP_ORDERING_H_
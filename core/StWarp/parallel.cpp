@@ -0,0 +1,360 @@
+#include "StWarp/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef STWARP_WITH_OPENMP
+#include <omp.h>
+#endif
+#ifdef STWARP_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace StWarp {
+
+namespace {
+
+#ifdef STWARP_WITH_OPENMP
+ParallelBackend g_backend = ParallelBackend::kOpenMP;
+#else
+ParallelBackend g_backend = ParallelBackend::kThreadPool;
+#endif
+int g_max_threads = 0;
+std::vector<int> g_affinity;
+bool g_pin = false;
+std::mutex g_config_mutex;
+
+// set on threads running a parallel body, nested loops run serially
+thread_local bool t_in_parallel = false;
+
+// cgroup v2 cpu.max "quota period", or v1 cfs_quota_us and cfs_period_us.
+// 0 if there is no quota.
+int cgroupThreads() {
+  double quota = -1.0;
+  double period = 0.0;
+  std::ifstream v2("/sys/fs/cgroup/cpu.max");
+  std::string max;
+  if (v2 >> max >> period) {
+    if (max != "max") quota = std::atof(max.c_str());
+  } else {
+    std::ifstream v1_quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream v1_period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    if (!(v1_quota >> quota) || !(v1_period >> period)) quota = -1.0;
+  }
+  if (quota <= 0.0 || period <= 0.0) return 0;
+  return std::max(1, (int)std::ceil(quota / period));
+}
+
+// NUMA node of every cpu, -1 for unknown ones
+std::vector<int> cpuNodes() {
+  std::vector<int> node_of;
+  for (int node = 0;; node++) {
+    std::ifstream file("/sys/devices/system/node/node" +
+                       std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!(file >> list)) break;
+    std::vector<int> cpus;
+    if (!parseCpuList(list, cpus)) continue;
+    for (int cpu : cpus) {
+      if (cpu >= (int)node_of.size()) node_of.resize(cpu + 1, -1);
+      node_of[cpu] = node;
+    }
+  }
+  return node_of;
+}
+
+// cpus of the process, or the given ones, ordered by NUMA node
+std::vector<int> pinnedCpus(std::vector<int> cpus) {
+#ifdef __linux__
+  if (cpus.empty()) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+#endif
+  std::vector<int> node_of = cpuNodes();
+  auto node = [&](int cpu) {
+    return cpu < (int)node_of.size() ? node_of[cpu] : -1;
+  };
+  std::stable_sort(cpus.begin(), cpus.end(),
+                   [&](int a, int b) { return node(a) < node(b); });
+  return cpus;
+}
+
+int affinityThreads() {
+#ifdef __linux__
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) return CPU_COUNT(&set);
+#endif
+  return 0;
+}
+
+// Plugin owned threads, idle ones wait on a condition variable. run() hands
+// the same body to the first n_workers - 1 threads and runs worker 0 on the
+// calling thread.
+class ThreadPool {
+ public:
+  ThreadPool(int n_threads, const std::vector<int>& cpus) {
+    for (int t = 0; t < n_threads; t++) {
+      threads_.emplace_back([this, t]() { loop(t + 1); });
+#ifdef __linux__
+      if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[t % cpus.size()], &set);
+        pthread_setaffinity_np(threads_.back().native_handle(), sizeof(set),
+                               &set);
+      }
+#endif
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+  }
+
+  int size() const { return threads_.size() + 1; }
+
+  void run(int n_workers, const std::function<void(int, int)>& body) {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      body_ = &body;
+      n_workers_ = n_workers;
+      pending_ = n_workers - 1;
+      generation_++;
+    }
+    wake_.notify_all();
+    t_in_parallel = true;
+    body(0, n_workers);
+    t_in_parallel = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    body_ = nullptr;
+  }
+
+ private:
+  void loop(int worker) {
+    t_in_parallel = true;
+    long long seen = 0;
+    while (true) {
+      const std::function<void(int, int)>* body;
+      int n_workers;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+        body = body_;
+        n_workers = n_workers_;
+      }
+      if (worker >= n_workers) continue;
+      (*body)(worker, n_workers);
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) done_.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  // one run at a time, e.g. deformers evaluated in parallel by Maya
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  const std::function<void(int, int)>* body_ = nullptr;
+  int n_workers_ = 0;
+  int pending_ = 0;
+  long long generation_ = 0;
+  bool stop_ = false;
+};
+
+std::shared_ptr<ThreadPool> g_pool;
+
+std::shared_ptr<ThreadPool> threadPool(int n_threads) {
+  std::lock_guard<std::mutex> lock(g_config_mutex);
+  if (!g_pool || g_pool->size() < n_threads) {
+    // worker 0 is the calling thread, the pool threads take the next cpus
+    std::vector<int> cpus = g_affinity;
+    if (g_pin) {
+      cpus = pinnedCpus(cpus);
+      if (!cpus.empty())
+        std::rotate(cpus.begin(), cpus.begin() + 1, cpus.end());
+    }
+    g_pool = std::make_shared<ThreadPool>(n_threads - 1, cpus);
+  }
+  return g_pool;
+}
+
+}  // namespace
+
+void setParallelBackend(ParallelBackend backend) {
+#ifndef STWARP_WITH_OPENMP
+  if (backend == ParallelBackend::kOpenMP)
+    backend = ParallelBackend::kThreadPool;
+#endif
+#ifndef STWARP_WITH_TBB
+  if (backend == ParallelBackend::kTBB) backend = ParallelBackend::kThreadPool;
+#endif
+  g_backend = backend;
+}
+
+ParallelBackend parallelBackend() { return g_backend; }
+
+void setMaxThreads(int max_threads) { g_max_threads = max_threads; }
+
+void setThreadAffinity(const std::vector<int>& cpus) {
+  std::lock_guard<std::mutex> lock(g_config_mutex);
+  if (cpus == g_affinity) return;
+  g_affinity = cpus;
+  // the pool is rebuilt with the new cpus on its next use
+  g_pool.reset();
+}
+
+void setThreadPinning(bool pin) {
+  std::lock_guard<std::mutex> lock(g_config_mutex);
+  if (pin == g_pin) return;
+  g_pin = pin;
+  g_pool.reset();
+}
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+  cpus.clear();
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    int first, last;
+    char dash;
+    std::stringstream range(item);
+    if (!(range >> first)) return false;
+    last = first;
+    if (range >> dash && (dash != '-' || !(range >> last))) return false;
+    if (first < 0 || last < first) return false;
+    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+  }
+  return !cpus.empty();
+}
+
+int availableThreads() {
+  static const int available = []() {
+    int n = std::max(1u, std::thread::hardware_concurrency());
+    int affinity = affinityThreads();
+    if (affinity > 0) n = std::min(n, affinity);
+    int quota = cgroupThreads();
+    if (quota > 0) n = std::min(n, quota);
+    return n;
+  }();
+  return available;
+}
+
+int parallelThreads() {
+  int n = availableThreads();
+  if (!g_affinity.empty()) n = std::min(n, (int)g_affinity.size());
+  if (g_max_threads > 0) n = std::min(n, g_max_threads);
+  return n;
+}
+
+bool inHostThread() {
+#ifdef STWARP_WITH_TBB
+  return !t_in_parallel && tbb::this_task_arena::current_thread_index() !=
+                               tbb::task_arena::not_initialized;
+#else
+  return false;
+#endif
+}
+
+void parallelWorkers(int n_workers,
+                     const std::function<void(int, int)>& body) {
+  if (n_workers <= 1 || t_in_parallel) {
+    for (int w = 0; w < n_workers; w++) body(w, n_workers);
+    return;
+  }
+  switch (g_backend) {
+#ifdef STWARP_WITH_OPENMP
+    case ParallelBackend::kOpenMP:
+#pragma omp parallel num_threads(n_workers)
+      {
+        t_in_parallel = true;
+        // the team may be smaller than asked for
+        for (int w = omp_get_thread_num(); w < n_workers;
+             w += omp_get_num_threads())
+          body(w, n_workers);
+        t_in_parallel = false;
+      }
+      return;
+#endif
+#ifdef STWARP_WITH_TBB
+    case ParallelBackend::kTBB: {
+      tbb::task_arena arena(n_workers);
+      arena.execute([&]() {
+        tbb::parallel_for(
+            0, n_workers, 1,
+            [&](int w) {
+              bool nested = t_in_parallel;
+              t_in_parallel = true;
+              body(w, n_workers);
+              t_in_parallel = nested;
+            },
+            tbb::simple_partitioner());
+      });
+      return;
+    }
+#endif
+    default:
+      threadPool(n_workers)->run(n_workers, body);
+      return;
+  }
+}
+
+void parallelForRange(int begin, int end,
+                      const std::function<void(int, int)>& body, int grain) {
+  int n = end - begin;
+  if (n <= 0) return;
+  int n_threads = parallelThreads();
+  if (grain <= 0) grain = std::max(1, n / (8 * n_threads));
+  int n_chunks = (n + grain - 1) / grain;
+  int n_workers = std::min(n_threads, n_chunks);
+  if (n_workers <= 1 || t_in_parallel) {
+    body(begin, end);
+    return;
+  }
+  std::atomic<int> next_chunk(0);
+  parallelWorkers(n_workers, [&](int, int) {
+    for (int c = next_chunk++; c < n_chunks; c = next_chunk++) {
+      int first = begin + c * grain;
+      body(first, std::min(first + grain, end));
+    }
+  });
+}
+
+void parallelForStatic(int begin, int end,
+                       const std::function<void(int, int)>& body) {
+  if (end <= begin) return;
+  int n_workers = std::min(parallelThreads(), end - begin);
+  parallelWorkers(n_workers, [&](int worker, int) {
+    body(shareBegin(begin, end, worker, n_workers),
+         shareBegin(begin, end, worker + 1, n_workers));
+  });
+}
+
+}  // namespace StWarp
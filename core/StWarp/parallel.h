@@ -0,0 +1,90 @@
+#ifndef STWARP_PARALLEL_H_
+#define STWARP_PARALLEL_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace StWarp {
+
+// Threading used by the solver and the deformer. Inside Maya the TBB
+// backend shares the evaluation manager's threads instead of adding its
+// own, the thread pool sleeps instead of spinning when idle.
+enum class ParallelBackend {
+  kOpenMP,
+  // only with STWARP_WITH_TBB, otherwise kThreadPool is used
+  kTBB,
+  // threads owned by the plugin, pinned to the affinity cpus if given
+  kThreadPool
+};
+
+void setParallelBackend(ParallelBackend backend);
+ParallelBackend parallelBackend();
+
+// At most this many threads, 0 for all available ones.
+void setMaxThreads(int max_threads);
+// cpus the thread pool runs on, empty for those of the process. Every
+// backend uses at most this many threads.
+void setThreadAffinity(const std::vector<int>& cpus);
+
+// Pins every pool thread to one cpu, of the affinity cpus if given or else
+// of the process, ordered by NUMA node. Pool worker k then always runs on
+// the same cpu and consecutive workers share a node, see
+// parallelForStatic. Stays in effect until called with false, which
+// rebuilds the pool unpinned.
+void setThreadPinning(bool pin);
+
+// Cpu list such as "0-7,16,18", false if it does not parse.
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+
+// Cpus this process may use: the hardware threads, limited by the affinity
+// mask of the process and the cgroup cpu quota of its container.
+int availableThreads();
+// Threads the parallel loops below run on.
+int parallelThreads();
+
+// Whether the calling thread is a worker of the host's TBB scheduler, e.g.
+// of Maya's parallel evaluation, other than one of our own tbb workers.
+// Always false without STWARP_WITH_TBB.
+bool inHostThread();
+
+// Runs body(worker, n_workers) once for each worker in [0, n_workers), on
+// up to n_workers threads. The workers may run one after another, they must
+// not wait for each other. Nested calls run on the calling thread.
+void parallelWorkers(int n_workers,
+                     const std::function<void(int, int)>& body);
+
+// body(first, last) over chunks of [begin, end) of about grain items, the
+// chunks are handed out to the threads dynamically. grain 0 picks a few
+// chunks per thread.
+void parallelForRange(int begin, int end,
+                      const std::function<void(int, int)>& body,
+                      int grain = 0);
+
+// First item of the share of worker when [begin, end) is split evenly over
+// n_workers.
+inline int shareBegin(int begin, int end, int worker, int n_workers) {
+  return begin + (long long)(end - begin) * worker / n_workers;
+}
+
+// body(first, last) once per worker on its share of [begin, end) split over
+// parallelThreads() workers. The same items always go to the same worker,
+// so with pinned threads memory first touched here stays on the NUMA node
+// of the threads that later work on it.
+void parallelForStatic(int begin, int end,
+                       const std::function<void(int, int)>& body);
+
+// body(i) for every i in [begin, end), the replacement of omp parallel for.
+template <typename Body>
+void parallelFor(int begin, int end, const Body& body, int grain = 0) {
+  parallelForRange(
+      begin, end,
+      [&](int first, int last) {
+        for (int i = first; i < last; i++) body(i);
+      },
+      grain);
+}
+
+}  // namespace StWarp
+
+#endif  // STWARP_PARALLEL_H_
@@ -0,0 +1,117 @@
+#include "StWarp/proxy.h"
+
+#include <algorithm>
+#include <array>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "StWarp/barycentric.h"
+#include "StWarp/bvh.h"
+#include "StWarp/parallel.h"
+
+namespace StWarp {
+
+namespace {
+
+ProxyMesh buildProxy(const MatxXd& verts, const Vecxi& vert_map,
+                     const Vecxi& face_counts, const Vecxi& face_connects) {
+  ProxyMesh proxy;
+  proxy.verts = verts;
+  std::set<std::array<int, 3>> seen;
+  std::vector<Vec3i> tris;
+  int offset = 0;
+  for (int f = 0; f < face_counts.size(); f++) {
+    int count = face_counts[f];
+    int a = vert_map[face_connects[offset]];
+    for (int k = 1; k + 1 < count; k++) {
+      int b = vert_map[face_connects[offset + k]];
+      int c = vert_map[face_connects[offset + k + 1]];
+      if (a == b || b == c || c == a) continue;
+      std::array<int, 3> key = {a, b, c};
+      std::sort(key.begin(), key.end());
+      if (!seen.insert(key).second) continue;
+      tris.emplace_back(a, b, c);
+    }
+    offset += count;
+  }
+  proxy.tris.resize(tris.size(), 3);
+  for (size_t t = 0; t < tris.size(); t++) proxy.tris.row(t) = tris[t];
+  return proxy;
+}
+
+}  // namespace
+
+ProxyMesh decimateMesh(const MatxXd& verts, const Vecxi& face_counts,
+                       const Vecxi& face_connects, int resolution) {
+  int n_verts = verts.rows();
+  Vec3d box_min = verts.colwise().minCoeff().transpose();
+  Vec3d box_max = verts.colwise().maxCoeff().transpose();
+  double cell = (box_max - box_min).maxCoeff() / std::max(resolution, 1);
+  if (cell <= 0.0) cell = 1.0;
+
+  std::unordered_map<long long, int> clusters;
+  Vecxi vert_map(n_verts);
+  std::vector<Vec3d> sums;
+  std::vector<int> counts;
+  for (int i = 0; i < n_verts; i++) {
+    Vec3d v = verts.row(i).transpose();
+    long long x = (long long)((v(0) - box_min(0)) / cell);
+    long long y = (long long)((v(1) - box_min(1)) / cell);
+    long long z = (long long)((v(2) - box_min(2)) / cell);
+    long long key = (x * (resolution + 1) + y) * (resolution + 1) + z;
+    auto it = clusters.find(key);
+    if (it == clusters.end()) {
+      it = clusters.emplace(key, (int)sums.size()).first;
+      sums.push_back(Vec3d::Zero());
+      counts.push_back(0);
+    }
+    vert_map[i] = it->second;
+    sums[it->second] += v;
+    counts[it->second]++;
+  }
+
+  MatxXd proxy_verts(sums.size(), 3);
+  for (size_t c = 0; c < sums.size(); c++)
+    proxy_verts.row(c) = (sums[c] / counts[c]).transpose();
+  return buildProxy(proxy_verts, vert_map, face_counts, face_connects);
+}
+
+ProxyMesh triangulateMesh(const MatxXd& verts, const Vecxi& face_counts,
+                          const Vecxi& face_connects) {
+  Vecxi identity = Vecxi::LinSpaced(verts.rows(), 0, verts.rows() - 1);
+  return buildProxy(verts, identity, face_counts, face_connects);
+}
+
+MatxXd transferWeights(const ProxyMesh& proxy,
+                       const Eigen::Ref<const MatxXd>& proxy_weights,
+                       const MatxXd& points) {
+  TriangleBVH bvh(proxy.verts, proxy.tris);
+  int n_points = points.rows();
+  MatxXd weights(n_points, proxy_weights.cols());
+
+  parallelFor(0, n_points, [&](int i) {
+    Vec3d p = points.row(i).transpose();
+    Vec3d cp;
+    int t;
+    bvh.closest_point(p, cp, t);
+    Vec3d p0 = proxy.verts.row(proxy.tris(t, 0)).transpose();
+    Vec3d p1 = proxy.verts.row(proxy.tris(t, 1)).transpose();
+    Vec3d p2 = proxy.verts.row(proxy.tris(t, 2)).transpose();
+    Vec3d bary = computeBarycentricCoordinates(cp, p0, p1, p2);
+    if (bary.isZero()) {
+      // sliver triangle, use its closest corner
+      Vec3d d((p0 - p).squaredNorm(), (p1 - p).squaredNorm(),
+              (p2 - p).squaredNorm());
+      int k;
+      d.minCoeff(&k);
+      bary = Vec3d::Unit(k);
+    }
+    weights.row(i) = bary(0) * proxy_weights.row(proxy.tris(t, 0)) +
+                     bary(1) * proxy_weights.row(proxy.tris(t, 1)) +
+                     bary(2) * proxy_weights.row(proxy.tris(t, 2));
+  });
+  return weights;
+}
+
+}  // namespace StWarp
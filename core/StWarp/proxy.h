@@ -0,0 +1,32 @@
+#ifndef STWARP_PROXY_H_
+#define STWARP_PROXY_H_
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+// Triangle mesh standing in for the bound mesh during the walks.
+struct ProxyMesh {
+  MatxXd verts;
+  Matx3i tris;
+};
+
+// Coarse proxy by vertex clustering on a uniform grid with resolution cells
+// along the longest side of the bounding box. Each cluster is replaced by the
+// centroid of its vertices, collapsed triangles are dropped.
+ProxyMesh decimateMesh(const MatxXd& verts, const Vecxi& face_counts,
+                       const Vecxi& face_connects, int resolution);
+
+// Fan triangulation of a polygon mesh, for proxies given by the user.
+ProxyMesh triangulateMesh(const MatxXd& verts, const Vecxi& face_counts,
+                          const Vecxi& face_connects);
+
+// Weights at points interpolated from the proxy weights (one row per proxy
+// vertex) with the barycentric coordinates of the closest proxy point.
+MatxXd transferWeights(const ProxyMesh& proxy,
+                       const Eigen::Ref<const MatxXd>& proxy_weights,
+                       const MatxXd& points);
+
+}  // namespace StWarp
+
+#endif  // STWARP_PROXY_H_
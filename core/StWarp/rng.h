@@ -0,0 +1,96 @@
+#ifndef STWARP_RNG_H_
+#define STWARP_RNG_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace StWarp {
+
+// Counter based random numbers from the splitmix64 finalizer. Every walk
+// draws from its own key and step counter, so its path does not depend on
+// the thread running it or on the order of the walks.
+inline uint64_t mixBits(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+inline uint64_t walkKey(uint64_t vertex, uint64_t walk) {
+  return mixBits(vertex ^ mixBits(walk));
+}
+
+// uniform in [0, 1) with 62 random bits, converted as two 31 bit signed
+// integers which vectorizes on every x86 SIMD level
+inline double uniformAt(uint64_t key, uint64_t counter) {
+  uint64_t bits = mixBits(key + counter);
+  int32_t high = (int32_t)(bits >> 33);
+  int32_t low = (int32_t)((bits >> 2) & 0x7fffffff);
+  return high * 0x1.0p-31 + low * 0x1.0p-62;
+}
+
+// sin and cos of 2 pi u for u in [0, 1) without libm calls, so loops over
+// walks vectorize. u is reduced to r in [-pi/4, pi/4] around the nearest
+// quarter turn, the Taylor series of r are exact to about 1e-14.
+inline void sinCos2Pi(double u, double& s, double& c) {
+  int k = (int)(4.0 * u + 0.5);
+  double r = 2.0 * M_PI * (u - 0.25 * k);
+  double r2 = r * r;
+  double sr = r * (1.0 + r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 +
+              r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800 +
+              r2 * (1.0 / 6227020800)))))));
+  double cr = 1.0 + r2 * (-0.5 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 +
+              r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 +
+              r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200)))))));
+  // rotate by k quarter turns
+  k &= 3;
+  s = k == 0 ? sr : k == 1 ? cr : k == 2 ? -sr : -cr;
+  c = k == 0 ? cr : k == 1 ? -sr : k == 2 ? -cr : sr;
+}
+
+// Uniform direction on the unit sphere from the numbers counter and
+// counter + 1 of the stream key.
+inline void uniformDirection(uint64_t key, uint64_t counter, double& x,
+                             double& y, double& z) {
+  z = 2.0 * uniformAt(key, counter) - 1.0;
+  double s, c;
+  sinCos2Pi(uniformAt(key, counter + 1), s, c);
+  double r = std::sqrt(std::max(1.0 - z * z, 0.0));
+  x = r * c;
+  y = r * s;
+}
+
+// Float versions for walks in float. 24 random bits per number, enough for
+// the precision of the positions they move.
+inline float uniformAtf(uint64_t key, uint64_t counter) {
+  return (int32_t)(mixBits(key + counter) >> 40) * 0x1.0p-24f;
+}
+
+// same reduction as above, the series are exact to about 3e-8
+inline void sinCos2Pi(float u, float& s, float& c) {
+  int k = (int)(4.0f * u + 0.5f);
+  float r = 2.0f * (float)M_PI * (u - 0.25f * k);
+  float r2 = r * r;
+  float sr = r * (1.0f + r2 * (-1.0f / 6 + r2 * (1.0f / 120 +
+             r2 * (-1.0f / 5040 + r2 * (1.0f / 362880)))));
+  float cr = 1.0f + r2 * (-0.5f + r2 * (1.0f / 24 + r2 * (-1.0f / 720 +
+             r2 * (1.0f / 40320))));
+  k &= 3;
+  s = k == 0 ? sr : k == 1 ? cr : k == 2 ? -sr : -cr;
+  c = k == 0 ? cr : k == 1 ? -sr : k == 2 ? -cr : sr;
+}
+
+inline void uniformDirection(uint64_t key, uint64_t counter, float& x,
+                             float& y, float& z) {
+  z = 2.0f * uniformAtf(key, counter) - 1.0f;
+  float s, c;
+  sinCos2Pi(uniformAtf(key, counter + 1), s, c);
+  float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+  x = r * c;
+  y = r * s;
+}
+
+}  // namespace StWarp
+
+#endif  // STWARP_RNG_H_
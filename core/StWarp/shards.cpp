@@ -0,0 +1,218 @@
+#include <maya/MGlobal.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "StWarp/parallel.h"
+#include "StWarp/solver.h"
+#include "StWarp/timer.h"
+
+namespace StWarp {
+
+namespace {
+
+// Shard file: a ShardHeader, then per row the solve vertex index, its M and
+// its n_cage_verts entries of m, in native byte order.
+const char kShardMagic[4] = {'S', 'T', 'W', 'S'};
+const int32_t kShardVersion = 2;
+
+// bits of ShardHeader::walk_flags
+const int32_t kFloatWalks = 1;
+const int32_t kDeferredShading = 2;
+
+struct ShardHeader {
+  char magic[4];
+  int32_t version;
+  int32_t shard;
+  int32_t n_shards;
+  int32_t n_solve_verts;
+  int32_t n_cage_verts;
+  int64_t n_rows;
+  int64_t n_walks;
+  uint64_t binding;
+  // settings that change the sums of a walk, the same for every shard
+  int32_t walk_flags;
+  // nodes of the distance grid along each axis, 0 without one
+  int32_t grid_dims[3];
+};
+
+// FNV-1a of the solve points, the cage points and the mirror pairs, shards
+// of another binding or symmetry setting are rejected
+uint64_t bindingHash(const StoWarpSolver& solver) {
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&](const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t k = 0; k < size; k++) {
+      hash ^= bytes[k];
+      hash *= 1099511628211ull;
+    }
+  };
+  for (int i = 0; i < solver.n_solve_verts; i++) {
+    for (int c = 0; c < 3; c++) {
+      double x = solver.solve_verts(i, c);
+      add(&x, sizeof(x));
+    }
+  }
+  for (int j = 0; j < solver.n_cage_verts; j++) {
+    for (int c = 0; c < 3; c++) {
+      double x = solver.cage_verts(j, c);
+      add(&x, sizeof(x));
+    }
+  }
+  add(solver.mirror_of.data(), solver.mirror_of.size() * sizeof(int));
+  return hash;
+}
+
+int32_t walkFlags(const StoWarpSolver& solver) {
+  return (solver.float_walks ? kFloatWalks : 0) |
+         (solver.deferred_shading ? kDeferredShading : 0);
+}
+
+}  // namespace
+
+void StoWarpSolver::set_shard_tile(double eps) {
+  // shard takes its share of the walk blocks of all solve vertices, so its
+  // blocks are those of a single solver
+  tile_begin = 0;
+  tile_end = n_solve_verts;
+  std::vector<int> walked = walked_vertices(eps);
+  int n_walked = walked.size();
+  int n_blocks = (n_walked + kWalkBlockSize - 1) / kWalkBlockSize;
+  int first = shareBegin(0, n_blocks, shard, n_shards) * kWalkBlockSize;
+  int last = shareBegin(0, n_blocks, shard + 1, n_shards) * kWalkBlockSize;
+  last = std::min(last, n_walked);
+  if (first >= last) return set_tile(0, 0);
+  set_tile(walked[first], walked[last - 1] + 1);
+}
+
+void StoWarpSolver::save_shard(const std::string& path) {
+  ScopedTimer timer("save_shard");
+  // the walked rows are the ones with samples, M(3, 3) counts them
+  std::vector<int32_t> rows;
+  for (int i = tile_begin; i < tile_end && !M.empty(); i++) {
+    if (M_row(i)(3, 3) > 0.0) rows.push_back(i);
+  }
+
+  ShardHeader header;
+  std::memcpy(header.magic, kShardMagic, sizeof(kShardMagic));
+  header.version = kShardVersion;
+  header.shard = shard;
+  header.n_shards = n_shards;
+  header.n_solve_verts = n_solve_verts;
+  header.n_cage_verts = n_cage_verts;
+  header.n_rows = rows.size();
+  header.n_walks = n_walks_done;
+  header.binding = bindingHash(*this);
+  header.walk_flags = walkFlags(*this);
+  for (int c = 0; c < 3; c++)
+    header.grid_dims[c] = distance_grid ? distance_grid->dims(c) : 0;
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (int32_t i : rows) {
+    file.write(reinterpret_cast<const char*>(&i), sizeof(i));
+    file.write(reinterpret_cast<const char*>(M_row(i).data()), sizeof(Mat4d));
+    file.write(reinterpret_cast<const char*>(m_row(i)->data()),
+               n_cage_verts * sizeof(Vec4d));
+  }
+  file.close();
+  if (!file) {
+    MGlobal::displayError(("Failed to write shard file " + path).c_str());
+    status = MS::kFailure;
+    return;
+  }
+
+  std::stringstream ss;
+  ss << "Shard " << shard << " of " << n_shards << ": " << rows.size()
+     << " vertices written to " << path;
+  MGlobal::displayInfo(ss.str().c_str());
+  timer.print();
+}
+
+void StoWarpSolver::merge_shards(const std::vector<std::string>& paths,
+                                 double eps) {
+  ScopedTimer timer("merge_shards");
+  cache_first_step();
+  classify_vertices(eps);
+  if (M.empty()) set_tile(tile_begin, tile_end);
+
+  auto fail = [&](const std::string& path, const char* reason) {
+    MGlobal::displayError(("Shard file " + path + ": " + reason).c_str());
+    status = MS::kFailure;
+  };
+  const uint64_t binding = bindingHash(*this);
+  std::vector<bool> merged;
+  ShardHeader first;
+  Mat4d Mi;
+  std::vector<Vec4d> mi(n_cage_verts);
+  for (const std::string& path : paths) {
+    std::ifstream file(path, std::ios::binary);
+    ShardHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kShardMagic, sizeof(kShardMagic)) != 0) {
+      return fail(path, "not a shard file.");
+    }
+    if (header.version != kShardVersion)
+      return fail(path, "unsupported version.");
+    if (header.n_solve_verts != n_solve_verts ||
+        header.n_cage_verts != n_cage_verts || header.binding != binding) {
+      return fail(path, "written for another mesh, cage or symmetry.");
+    }
+    if (merged.empty()) {
+      merged.assign(header.n_shards, false);
+      n_walks_done = header.n_walks;
+      first = header;
+    }
+    if (header.n_shards != (int)merged.size() ||
+        header.n_walks != n_walks_done) {
+      return fail(path, "shard count or walks differ from the other files.");
+    }
+    if (header.walk_flags != first.walk_flags ||
+        std::memcmp(header.grid_dims, first.grid_dims,
+                    sizeof(header.grid_dims)) != 0) {
+      return fail(path,
+                  "-floatWalks, -deferredShading or -distanceGrid differ "
+                  "from the other files.");
+    }
+    if (header.shard < 0 || header.shard >= header.n_shards ||
+        merged[header.shard]) {
+      return fail(path, "shard index out of range or given twice.");
+    }
+    merged[header.shard] = true;
+
+    for (int64_t r = 0; r < header.n_rows; r++) {
+      int32_t i;
+      file.read(reinterpret_cast<char*>(&i), sizeof(i));
+      file.read(reinterpret_cast<char*>(Mi.data()), sizeof(Mat4d));
+      file.read(reinterpret_cast<char*>(mi.data()),
+                n_cage_verts * sizeof(Vec4d));
+      if (!file || i < tile_begin || i >= tile_end)
+        return fail(path, "truncated or corrupt.");
+      M_row(i) += Mi;
+      Vec4d* sums = m_row(i);
+      for (int j = 0; j < n_cage_verts; j++) sums[j] += mi[j];
+    }
+  }
+  if (merged.empty()) {
+    MGlobal::displayError("No shard files to merge.");
+    status = MS::kFailure;
+    return;
+  }
+  for (size_t s = 0; s < merged.size(); s++) {
+    if (!merged[s]) {
+      std::stringstream ss;
+      ss << "Shard " << s << " of " << merged.size() << " was not given.";
+      MGlobal::displayError(ss.str().c_str());
+      status = MS::kFailure;
+      return;
+    }
+  }
+
+  solve_weights(eps);
+  timer.print();
+}
+
+}  // namespace StWarp
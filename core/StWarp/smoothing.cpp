@@ -0,0 +1,178 @@
+#include "StWarp/smoothing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "StWarp/parallel.h"
+
+namespace StWarp {
+
+namespace {
+
+// Upper bound of the spectral radius of the Jacobi iteration matrix
+// strength * D^-1 A, with D = I + strength * diag(A 1).
+double jacobiSpectralBound(const SparseRowMatd& adjacency, double strength) {
+  double rho = 0.0;
+  for (int i = 0; i < adjacency.outerSize(); i++) {
+    double degree = 0.0;
+    for (SparseRowMatd::InnerIterator it(adjacency, i); it; ++it)
+      degree += it.value();
+    rho = std::max(rho, strength * degree / (1.0 + strength * degree));
+  }
+  return rho;
+}
+
+// Chebyshev semi-iterative weights, see Wang 2015 "A Chebyshev
+// Semi-Iterative Approach for Accelerating Projective and Position-based
+// Dynamics". omega is the weight of the previous sweep.
+double chebyshevOmega(int k, double rho, double omega) {
+  if (k == 0) return 1.0;
+  if (k == 1) return 2.0 / (2.0 - rho * rho);
+  return 4.0 / (4.0 - rho * rho * omega);
+}
+
+template <typename RowType>
+void normalizeRow(RowType&& row) {
+  double sum = row.sum();
+  if (std::abs(sum) > 1e-12) row /= sum;
+}
+
+}  // namespace
+
+SparseRowMatd buildMeshAdjacency(int n_verts, const Vecxi& face_counts,
+                                 const Vecxi& face_connects) {
+  std::vector<Tripletd> triplets;
+  triplets.reserve(2 * face_connects.size());
+  int offset = 0;
+  for (int f = 0; f < face_counts.size(); f++) {
+    int count = face_counts[f];
+    for (int k = 0; k < count; k++) {
+      int a = face_connects[offset + k];
+      int b = face_connects[offset + (k + 1) % count];
+      triplets.emplace_back(a, b, 1.0);
+      triplets.emplace_back(b, a, 1.0);
+    }
+    offset += count;
+  }
+  SparseRowMatd adjacency(n_verts, n_verts);
+  // interior edges are shared by two faces, keep a single unit entry
+  adjacency.setFromTriplets(triplets.begin(), triplets.end(),
+                            [](double a, double) { return a; });
+  return adjacency;
+}
+
+void smoothWeights(Eigen::Ref<MatxXd> weights, const SparseRowMatd& adjacency,
+                   int iterations, double strength, SmoothingScheme scheme) {
+  if (iterations <= 0 || strength <= 0.0) return;
+  const int n = weights.rows();
+  const double rho = jacobiSpectralBound(adjacency, strength);
+
+  // The sweeps rotate through weights and two buffers, the previous sweep
+  // is only kept for Chebyshev.
+  const MatxXd rhs = weights;
+  MatxXd buffer(weights.rows(), weights.cols());
+  MatxXd last;
+  if (scheme == SmoothingScheme::kChebyshev) last = weights;
+  Eigen::Ref<MatxXd> buffer_ref(buffer);
+  Eigen::Ref<MatxXd> last_ref(last);
+  Eigen::Ref<MatxXd>* cur = &weights;
+  Eigen::Ref<MatxXd>* next = &buffer_ref;
+  Eigen::Ref<MatxXd>* prev = &last_ref;
+  double omega = 1.0;
+  for (int k = 0; k < iterations; k++) {
+    if (scheme == SmoothingScheme::kChebyshev)
+      omega = chebyshevOmega(k, rho, omega);
+    parallelFor(0, n, [&](int i) {
+      auto row = next->row(i);
+      row = rhs.row(i);
+      double diag = 1.0;
+      for (SparseRowMatd::InnerIterator it(adjacency, i); it; ++it) {
+        row += strength * it.value() * cur->row(it.index());
+        diag += strength * it.value();
+      }
+      row /= diag;
+      if (omega != 1.0) row = omega * (row - prev->row(i)) + prev->row(i);
+    });
+    if (scheme == SmoothingScheme::kChebyshev) {
+      std::swap(prev, cur);
+      std::swap(cur, next);
+    } else {
+      std::swap(cur, next);
+    }
+  }
+  if (cur != &weights) weights = *cur;
+
+  parallelFor(0, n, [&](int i) { normalizeRow(weights.row(i)); });
+}
+
+void smoothWeights(SparseRowMatd& weights, const SparseRowMatd& adjacency,
+                   int iterations, double strength, SmoothingScheme scheme,
+                   double prune_eps) {
+  if (iterations <= 0 || strength <= 0.0) return;
+  const int n = weights.rows();
+  const int n_cols = weights.cols();
+  const double rho = jacobiSpectralBound(adjacency, strength);
+
+  const SparseRowMatd rhs = weights;
+  SparseRowMatd prev = weights;
+  std::vector<std::vector<int>> row_idx(n);
+  std::vector<std::vector<double>> row_val(n);
+  double omega = 1.0;
+  for (int k = 0; k < iterations; k++) {
+    if (scheme == SmoothingScheme::kChebyshev)
+      omega = chebyshevOmega(k, rho, omega);
+    parallelForRange(0, n, [&](int first, int last) {
+      // n_cols is the cage size, a dense scratch row per chunk is cheap
+      Vecxd row(n_cols);
+      for (int i = first; i < last; i++) {
+        row.setZero();
+        for (SparseRowMatd::InnerIterator it(rhs, i); it; ++it)
+          row[it.index()] += it.value();
+        double diag = 1.0;
+        for (SparseRowMatd::InnerIterator it(adjacency, i); it; ++it) {
+          for (SparseRowMatd::InnerIterator jt(weights, it.index()); jt; ++jt)
+            row[jt.index()] += strength * it.value() * jt.value();
+          diag += strength * it.value();
+        }
+        row /= diag;
+        if (omega != 1.0) {
+          row *= omega;
+          for (SparseRowMatd::InnerIterator it(prev, i); it; ++it)
+            row[it.index()] += (1.0 - omega) * it.value();
+        }
+        row_idx[i].clear();
+        row_val[i].clear();
+        for (int j = 0; j < n_cols; j++) {
+          if (std::abs(row[j]) > prune_eps) {
+            row_idx[i].push_back(j);
+            row_val[i].push_back(row[j]);
+          }
+        }
+      }
+    });
+
+    Vecxi nnz(n);
+    for (int i = 0; i < n; i++) nnz[i] = row_idx[i].size();
+    SparseRowMatd next(n, n_cols);
+    next.reserve(nnz);
+    for (int i = 0; i < n; i++) {
+      for (size_t e = 0; e < row_idx[i].size(); e++)
+        next.insert(i, row_idx[i][e]) = row_val[i][e];
+    }
+    next.makeCompressed();
+    prev.swap(weights);
+    weights.swap(next);
+  }
+
+  parallelFor(0, n, [&](int i) {
+    double sum = 0.0;
+    for (SparseRowMatd::InnerIterator it(weights, i); it; ++it)
+      sum += it.value();
+    if (std::abs(sum) <= 1e-12) return;
+    for (SparseRowMatd::InnerIterator it(weights, i); it; ++it)
+      it.valueRef() /= sum;
+  });
+}
+
+}  // namespace StWarp
@@ -0,0 +1,34 @@
+#ifndef STWARP_SMOOTHING_H_
+#define STWARP_SMOOTHING_H_
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+enum class SmoothingScheme {
+  kJacobi,     // plain Jacobi sweeps
+  kChebyshev,  // Chebyshev semi-iterative acceleration of the Jacobi sweeps
+};
+
+// Vertex adjacency of a polygon mesh given in maya's (faceCounts,
+// faceConnects) layout. Every edge appears once per direction with value 1.
+SparseRowMatd buildMeshAdjacency(int n_verts, const Vecxi& face_counts,
+                                 const Vecxi& face_connects);
+
+// Smooths per-vertex weights (one row per mesh vertex) by approximately
+// solving (I + strength * L) W = W0, where L is the uniform graph Laplacian
+// of adjacency. Each sweep is a convex (Jacobi) or affine (Chebyshev)
+// combination of rows, so rows that sum to one keep summing to one. The
+// weights are smoothed in place, e.g. in the attribute buffer.
+void smoothWeights(Eigen::Ref<MatxXd> weights, const SparseRowMatd& adjacency,
+                   int iterations, double strength, SmoothingScheme scheme);
+
+// Same as above for sparse weights. Entries below prune_eps are dropped after
+// every sweep to keep the fill-in bounded by the graph neighbourhood.
+void smoothWeights(SparseRowMatd& weights, const SparseRowMatd& adjacency,
+                   int iterations, double strength, SmoothingScheme scheme,
+                   double prune_eps = 1e-8);
+
+}  // namespace StWarp
+
+#endif  // STWARP_SMOOTHING_H_
@@ -7,15 +7,42 @@
 #include <maya/MTypeId.h>
 #include <maya/MObject.h>
 #include <maya/MIntArray.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <new>
 #include <sstream>
+#include <type_traits>
 
 #include "Eigen/Dense"
 #include "StWarp/type.h"
 #include "StWarp/barycentric.h"
+#include "StWarp/batch_solve.h"
+#include "StWarp/cpu_dispatch.h"
 #include "StWarp/timer.h"
+#include "StWarp/weld.h"
+#include "StWarp/ordering.h"
+#include "StWarp/parallel.h"
+#include "StWarp/tasks.h"
 
 namespace StWarp {
 
+// a skipped query still has to give a sphere this fraction of the distance
+// to the tracked face, otherwise the walk would crawl
+const double kSkipRatio = 0.5;
+
+// The grid bound is at least the distance minus two cell diagonals. Beyond
+// this many diagonals it is within kSkipRatio of the distance.
+const double kGridShell = 2.0;
+
+// mesh vertices closer than this fraction of the mesh bounding box diagonal
+// are welded
+const double kWeldTolerance = 1e-7;
+
+// mirror correspondences are matched within this fraction of the cage
+// bounding box diagonal
+const double kMirrorTolerance = 1e-5;
+
 inline float random(float rMin, float rMax) {
   const float rRandMax = 1. / (float)RAND_MAX;
   float u = rRandMax * (float)rand();
@@ -35,6 +62,41 @@ Vec3d generateRandomDirection() {
   return dir;
 }
 
+PointsView pointsView(const MPointArray& points) {
+  // MPoint is x, y, z, w doubles, the array stores them contiguously
+  static_assert(sizeof(MPoint) == 4 * sizeof(double), "MPoint layout");
+  const double* data = points.length() > 0 ? &points[0].x : nullptr;
+  return PointsView(data, points.length(), 3, Eigen::OuterStride<>(4));
+}
+
+PointsView pointsView(const MatxXd& points) {
+  return PointsView(points.data(), points.rows(), 3,
+                    Eigen::OuterStride<>(points.cols()));
+}
+
+MStatus getMeshPoints(MFnMesh& fn, MatxXd& points) {
+  MPointArray mayaPoints;
+  MStatus status = fn.getPoints(mayaPoints, MSpace::kWorld);
+  if (status != MS::kSuccess) return status;
+  points = pointsView(mayaPoints);
+  return MS::kSuccess;
+}
+
+MStatus getMeshTopology(MFnMesh& fn, Vecxi& face_counts,
+                        Vecxi& face_connects) {
+  MIntArray faceCounts;
+  MIntArray faceConnects;
+  MStatus status = fn.getVertices(faceCounts, faceConnects);
+  if (status != MS::kSuccess) return status;
+  face_counts.resize(faceCounts.length());
+  face_connects.resize(faceConnects.length());
+  for (unsigned int i = 0; i < faceCounts.length(); i++)
+    face_counts[i] = faceCounts[i];
+  for (unsigned int i = 0; i < faceConnects.length(); i++)
+    face_connects[i] = faceConnects[i];
+  return MS::kSuccess;
+}
+
 StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn)
     : cageFn(cageFn), meshFn(meshFn) {
   MPointArray meshPoints;
@@ -43,6 +105,22 @@ StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn)
     MGlobal::displayError("Failed to get mesh points.");
     return;
   }
+  init(pointsView(meshPoints));
+}
+
+StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn,
+                             const MatxXd& points)
+    : cageFn(cageFn), meshFn(meshFn) {
+  init(pointsView(points));
+}
+
+StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn,
+                             const PointsView& points)
+    : cageFn(cageFn), meshFn(meshFn) {
+  init(points);
+}
+
+void StoWarpSolver::init(const PointsView& points) {
   MPointArray cagePoints;
   status = cageFn.getPoints(cagePoints, MSpace::kWorld);
   if (status != MS::kSuccess) {
@@ -51,26 +129,34 @@ StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn)
   }
 
   n_cage_verts = cagePoints.length();
-  n_mesh_verts = meshPoints.length();
-  M.resize(n_mesh_verts);
-  m.resize(n_mesh_verts * n_cage_verts);
-  harmonic_weights.resize(n_mesh_verts, n_cage_verts);
-  for (auto& Mi : M) Mi.setZero();
-  for (auto& mi : m) mi.setZero();
-  cage_verts.resize(n_cage_verts, 3);
-  mesh_verts.resize(n_mesh_verts, 3);
-
-  for (int i = 0; i < n_cage_verts; i++) {
-    cage_verts(i, 0) = cagePoints[i].x;
-    cage_verts(i, 1) = cagePoints[i].y;
-    cage_verts(i, 2) = cagePoints[i].z;
-  }
+  n_mesh_verts = points.rows();
+  // one n x 3 copy each, the maya arrays behind the views are temporaries
+  cage_verts = pointsView(cagePoints);
+  mesh_verts = points;
 
-  for (int i = 0; i < n_mesh_verts; i++) {
-    mesh_verts(i, 0) = meshPoints[i].x;
-    mesh_verts(i, 1) = meshPoints[i].y;
-    mesh_verts(i, 2) = meshPoints[i].z;
+  // coincident vertices are solved once
+  double diagonal = 0.0;
+  if (n_mesh_verts > 0)
+    diagonal = (mesh_verts.colwise().maxCoeff() -
+                mesh_verts.colwise().minCoeff())
+                   .norm();
+  solve_verts = weldPoints(mesh_verts, kWeldTolerance * diagonal, solve_row);
+  n_solve_verts = solve_verts.rows();
+
+  // solve in Morton order, so consecutive vertices of a thread share BVH
+  // nodes and cage faces in cache
+  Vecxi order = mortonOrder(solve_verts);
+  Vecxi rank(n_solve_verts);
+  MatxXd sorted_verts(n_solve_verts, 3);
+  for (int k = 0; k < n_solve_verts; k++) {
+    sorted_verts.row(k) = solve_verts.row(order[k]);
+    rank[order[k]] = k;
   }
+  solve_verts = sorted_verts;
+  for (int i = 0; i < n_mesh_verts; i++) solve_row[i] = rank[solve_row[i]];
+  tile_begin = 0;
+  tile_end = n_solve_verts;
+  mirror_of = Vecxi::Constant(n_solve_verts, -1);
 
   MIntArray faceCounts;
   MIntArray faceConnects;
@@ -107,17 +193,47 @@ StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn)
   for (int i = 0; i < n_cage_faces; i++) {
     int k = face_idx[i];
     if (faceCounts[i] == 3) {
-      tri_faces(face_idx[k], 0) = faceConnects[idx++];
-      tri_faces(face_idx[k], 1) = faceConnects[idx++];
-      tri_faces(face_idx[k], 2) = faceConnects[idx++];
+      tri_faces(k, 0) = faceConnects[idx++];
+      tri_faces(k, 1) = faceConnects[idx++];
+      tri_faces(k, 2) = faceConnects[idx++];
     } else if (faceCounts[i] == 4) {
-      quad_faces(face_idx[k], 0) = faceConnects[idx++];
-      quad_faces(face_idx[k], 1) = faceConnects[idx++];
-      quad_faces(face_idx[k], 2) = faceConnects[idx++];
-      quad_faces(face_idx[k], 3) = faceConnects[idx++];
+      quad_faces(k, 0) = faceConnects[idx++];
+      quad_faces(k, 1) = faceConnects[idx++];
+      quad_faces(k, 2) = faceConnects[idx++];
+      quad_faces(k, 3) = faceConnects[idx++];
     }
   }
 
+  // quads are split along the 0-2 diagonal for the distance queries
+  Matx3i bvh_tris(n_tri_faces + 2 * n_quad_faces, 3);
+  Vecxi bvh_groups(bvh_tris.rows());
+  face_tri_start.resize(n_cage_faces + 1);
+  int t = 0;
+  for (int i = 0; i < n_cage_faces; i++) {
+    int k = face_idx[i];
+    face_tri_start[i] = t;
+    if (face_type[i] == 0) {
+      bvh_tris.row(t) = tri_faces.row(k);
+      bvh_groups[t++] = i;
+    } else {
+      bvh_tris.row(t) << quad_faces(k, 0), quad_faces(k, 1), quad_faces(k, 2);
+      bvh_groups[t++] = i;
+      bvh_tris.row(t) << quad_faces(k, 0), quad_faces(k, 2), quad_faces(k, 3);
+      bvh_groups[t++] = i;
+    }
+  }
+  face_tri_start[n_cage_faces] = t;
+  cage_bvh = TriangleBVH(cage_verts, bvh_tris, bvh_groups);
+
+  faces.resize(n_cage_faces);
+  for (int i = 0; i < n_cage_faces; i++) {
+    int k = face_idx[i];
+    if (face_type[i] == 0)
+      faces[i] = setupCageFace(cage_verts, tri_faces.row(k).data(), 3);
+    else
+      faces[i] = setupCageFace(cage_verts, quad_faces.row(k).data(), 4);
+  }
+
   // !
   // walk_on_sphere(100, 1e-6, 200);
   /*walk_on_sphere(100, 1e-6, 200);
@@ -139,124 +255,462 @@ StoWarpSolver::StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn)
 
 double StoWarpSolver::closest_point_on_cage(const Vec3d& input_p,
                                             Vec3d& closest_point, int& fi) {
-  MPoint p(input_p(0), input_p(1), input_p(2));
-  MPoint cp;
-  status = cageFn.getClosestPoint(p, cp, MSpace::kWorld, &fi);
-  if (status != MS::kSuccess) {
-    MGlobal::displayError("Failed to get closest point.");
-    return -1;
+  double other_bound;
+  fi = -1;
+  return closest_point_on_cage(input_p, closest_point, fi, other_bound);
+}
+
+double StoWarpSolver::closest_point_on_cage(const Vec3d& input_p,
+                                            Vec3d& closest_point, int& fi,
+                                            double& other_bound) {
+  // seed with the triangles of the previous closest face
+  int seed[2] = {-1, -1};
+  int n_seed = 0;
+  if (fi >= 0) {
+    for (int t = face_tri_start[fi]; t < face_tri_start[fi + 1]; t++)
+      seed[n_seed++] = t;
   }
-  closest_point(0) = cp.x;
-  closest_point(1) = cp.y;
-  closest_point(2) = cp.z;
-  return (input_p - closest_point).norm();
+  int tri;
+  double distance = cage_bvh.closest_point(input_p, seed, n_seed,
+                                           closest_point, tri, other_bound);
+  fi = cage_bvh.groups[tri];
+  return distance;
+}
+
+double StoWarpSolver::distance_to_cage(const Vec3d& input_p, int& fi,
+                                       double& other_bound, double stop) {
+  int seed[2] = {-1, -1};
+  int n_seed = 0;
+  if (fi >= 0) {
+    for (int t = face_tri_start[fi]; t < face_tri_start[fi + 1]; t++)
+      seed[n_seed++] = t;
+  }
+  int tri;
+  double distance =
+      cage_bvh.distance(input_p, seed, n_seed, stop, tri, other_bound);
+  fi = cage_bvh.groups[tri];
+  return distance;
 }
 
 Vec3d StoWarpSolver::get_tri_barycentric(const Vec3d& p, const int fi) {
-  int j = face_idx(fi);
-  Vec3d p0 = cage_verts.row(tri_faces(j, 0)).transpose();
-  Vec3d p1 = cage_verts.row(tri_faces(j, 1)).transpose();
-  Vec3d p2 = cage_verts.row(tri_faces(j, 2)).transpose();
-  return computeBarycentricCoordinates(p, p0, p1, p2);
+  return faceWeights(faces[fi], p).head<3>();
 }
 
 Vec3d StoWarpSolver::tri_interpolate(const Vec3d& w, const int fi) {
-  int j = face_idx(fi);
-  return (w(0) * cage_verts.row(tri_faces(j, 0)) +
-          w(1) * cage_verts.row(tri_faces(j, 1)) +
-          w(2) * cage_verts.row(tri_faces(j, 2)))
+  const CageFace& face = faces[fi];
+  return (w(0) * cage_verts.row(face.verts[0]) +
+          w(1) * cage_verts.row(face.verts[1]) +
+          w(2) * cage_verts.row(face.verts[2]))
       .transpose();
 }
 
 Vec4d StoWarpSolver::get_quad_barycentric(const Vec3d& p, const int fi) {
-  int j = face_idx(fi);
-  Vec3d p0 = cage_verts.row(quad_faces(j, 0)).transpose();
-  Vec3d p1 = cage_verts.row(quad_faces(j, 1)).transpose();
-  Vec3d p2 = cage_verts.row(quad_faces(j, 2)).transpose();
-  Vec3d p3 = cage_verts.row(quad_faces(j, 3)).transpose();
-  return computeBilinearCoordinates(p, p0, p1, p2, p3);
+  return faceWeights(faces[fi], p);
 }
 
 Vec3d StoWarpSolver::quad_interpolate(const Vec4d& w, const int fi) {
-  int j = face_idx(fi);
-  return (w(0) * cage_verts.row(quad_faces(j, 0)) +
-          w(1) * cage_verts.row(quad_faces(j, 1)) +
-          w(2) * cage_verts.row(quad_faces(j, 2)) +
-          w(3) * cage_verts.row(quad_faces(j, 3)))
+  const CageFace& face = faces[fi];
+  return (w(0) * cage_verts.row(face.verts[0]) +
+          w(1) * cage_verts.row(face.verts[1]) +
+          w(2) * cage_verts.row(face.verts[2]) +
+          w(3) * cage_verts.row(face.verts[3]))
       .transpose();
 }
 
-void StoWarpSolver::walk_on_sphere_single_step(int maxSteps, double eps) {
-#pragma omp parallel for
-  for (int i = 0; i < n_mesh_verts; i++) {
-    Vec3d mp = mesh_verts.row(i).transpose();
+void StoWarpSolver::cache_first_step() {
+  first_radius.resize(n_solve_verts);
+  first_other.resize(n_solve_verts);
+  first_closest.resize(n_solve_verts, 3);
+  first_face.resize(n_solve_verts);
+  parallelFor(0, n_solve_verts, [&](int i) {
     Vec3d cp;
-    Vec4d sample_p;
-
-    double R = 1e10;
-    int steps = 0;
     int fi = -1;
-    while (R > eps && steps < maxSteps) {
-      sample_p << mp(0), mp(1), mp(2), 1.;
-      double distance = closest_point_on_cage(mp, cp, fi);
-      R = distance;
-      Vec3d dir = generateRandomDirection();
-      mp = mp + dir * R;
-      steps++;
-    }
-    M[i] += sample_p * sample_p.transpose();
-    if (face_type[fi] == 0) {
-      Vec3d bary = get_tri_barycentric(cp, fi);
-      for (int j = 0; j < 3; j++) {
-        int idx = tri_faces(face_idx[fi], j);
-        m[i * n_cage_verts + idx] += bary(j) * sample_p;
-      }
-    } else {
-      Vec4d bary = get_quad_barycentric(cp, fi);
-      for (int j = 0; j < 4; j++) {
-        int idx = quad_faces(face_idx[fi], j);
-        m[i * n_cage_verts + idx] += bary(j) * sample_p;
-      }
+    first_radius[i] = closest_point_on_cage(solve_verts.row(i).transpose(),
+                                            cp, fi, first_other[i]);
+    first_closest.row(i) = cp.transpose();
+    first_face[i] = fi;
+  });
+}
+
+void StoWarpSolver::classify_vertices(double eps) {
+  exterior.setZero(n_solve_verts);
+  parallelFor(0, n_solve_verts, [&](int i) {
+    if (first_radius[i] <= eps || mirror_of[i] >= 0) return;
+    double w = cage_bvh.winding_number(solve_verts.row(i).transpose());
+    // either orientation of the cage faces
+    exterior[i] = std::abs(w) < 0.5;
+  });
+  for (int i = 0; i < n_solve_verts; i++) {
+    if (mirror_of[i] >= 0) exterior[i] = exterior[mirror_of[i]];
+  }
+  n_exterior = 0;
+  for (int i = 0; i < n_mesh_verts; i++) n_exterior += exterior[solve_row[i]];
+  if (n_exterior > 0) {
+    std::stringstream ss;
+    ss << n_exterior << " mesh vertices are outside the cage, they take the "
+       << "weights of the closest cage point.";
+    MGlobal::displayWarning(ss.str().c_str());
+  }
+}
+
+void StoWarpSolver::set_face_weights(int i, Eigen::Ref<MatxXd> weights,
+                                     int row) {
+  weights.row(row).setZero();
+  const CageFace& face = faces[first_face[i]];
+  Vec4d bary = faceWeights(face, first_closest.row(i).transpose());
+  for (int j = 0; j < face.n_verts; j++)
+    weights(row, face.verts[j]) += bary(j);
+}
+
+void StoWarpSolver::walk_on_sphere_single_step(int maxSteps, double eps) {
+  // On or outside the cage, weights are taken from the closest face,
+  // mirrored vertices from their partner. Workers start on the blocks of the
+  // rows they first touched in set_tile and steal when done.
+  std::vector<int> walked = walked_vertices(eps);
+  int n_walked = walked.size();
+  int n_workers = parallelThreads();
+  TaskRanges ranges(block_shares(walked, kWalkBlockSize, n_workers));
+  parallelWorkers(n_workers, [&](int worker, int) {
+    for (int b = ranges.next(worker); b >= 0; b = ranges.next(worker)) {
+      int end = std::min((b + 1) * kWalkBlockSize, n_walked);
+      for (int k = b * kWalkBlockSize; k < end; k++)
+        single_step_walk(walked[k], maxSteps, eps);
     }
+  });
+}
+
+void StoWarpSolver::single_step_walk(int i, int maxSteps, double eps) {
+  // every walk from vertex i starts with the same cached query
+  Vec3d mp = solve_verts.row(i).transpose();
+
+  // R: radius of the next sphere, never larger than the distance to the
+  // cage. fi: closest face of the last cage query. other_bound: lower
+  // bound of the distance to every other face, the distance being
+  // 1-Lipschitz it shrinks by the length of every step. Steps only need
+  // distances, the closest point is computed once where the walk stops.
+  double R = first_radius[i];
+  double other_bound = first_other[i];
+  int fi = first_face[i];
+  int steps = 1;
+  while (R > eps && steps < maxSteps) {
+    mp = mp + generateRandomDirection() * R;
+    other_bound -= R;
+    steps++;
+    R = sphere_radius(mp, fi, other_bound, eps);
   }
+  accumulate_sample(i, mp, fi);
 }
 
-void StoWarpSolver::walk_on_sphere(int maxSteps, double eps, int n_walks) {
-  int total_threads;
-#pragma omp parallel reduction(+ : total_threads)
-  { total_threads++; }
+template <typename Scalar>
+void StoWarpSolver::walk_frame(Vec3d& origin, double& scale) const {
+  origin.setZero();
+  scale = 1.0;
+  if (std::is_same<Scalar, double>::value || n_cage_verts == 0) return;
+  Vec3d box_min = cage_verts.colwise().minCoeff().transpose();
+  Vec3d box_max = cage_verts.colwise().maxCoeff().transpose();
+  origin = 0.5 * (box_min + box_max);
+  double half_diagonal = 0.5 * (box_max - box_min).norm();
+  if (half_diagonal > 0.0) scale = half_diagonal;
+}
+
+double StoWarpSolver::sphere_radius(const Vec3d& p, int& fi,
+                                    double& other_bound, double eps) {
+  if (distance_grid) {
+    // far from the cage a grid lookup is enough for the next sphere
+    double grid_bound = distance_grid->lower_bound(p);
+    if (grid_bound >= kGridShell * distance_grid->diagonal) return grid_bound;
+  }
+
+  // within eps of the tracked face the walk ends here
+  double face_distance = faceDistance(faces[fi], p);
+  if (face_distance <= eps) return face_distance;
+
+  // a sphere of radius bound is inside the cage, skip the cage query
+  double bound = std::min(face_distance, other_bound);
+  if (bound >= kSkipRatio * face_distance) return bound;
+
+  return distance_to_cage(p, fi, other_bound, eps);
+}
+
+void StoWarpSolver::accumulate_sample(int i, const Vec3d& p, int fi) {
+  accumulate_sample(p, fi, M_row(i), m_row(i));
+}
+
+void StoWarpSolver::accumulate_sample(const Vec3d& p, int fi, Mat4d& Mi,
+                                      Vec4d* mi) {
+  const CageFace& face = faces[fi];
+  Vec3d cp;
+  faceDistance(face, p, cp);
+  Vec4d sample_p;
+  sample_p << p(0), p(1), p(2), 1.;
+  Mi += sample_p * sample_p.transpose();
+  Vec4d bary = faceWeights(face, cp);
+  for (int j = 0; j < face.n_verts; j++) {
+    mi[face.verts[j]] += bary(j) * sample_p;
+  }
+}
+
+std::vector<int> StoWarpSolver::walked_vertices(double eps) const {
+  std::vector<int> walked;
+  for (int i = tile_begin; i < tile_end; i++) {
+    if (first_radius[i] > eps && !exterior[i] && mirror_of[i] < 0)
+      walked.push_back(i);
+  }
+  return walked;
+}
+
+void StoWarpSolver::accumulate_walks(int maxSteps, double eps, int n_walks) {
   std::stringstream ss;
-  ss << "Total threads: " << total_threads;
+  ss << "Total threads: " << parallelThreads()
+     << ", kernels: " << kernelTarget();
   MGlobal::displayInfo(ss.str().c_str());
 
-  ScopedTimer timer("walk_on_sphere");
-  for (int i = 0; i < n_walks; i++) {
-    walk_on_sphere_single_step(maxSteps, eps);
+  cache_first_step();
+  classify_vertices(eps);
+  run_walks(maxSteps, eps, n_walks);
+}
+
+void StoWarpSolver::run_walks(int maxSteps, double eps, int n_walks) {
+  if (M.empty()) {
+    if (n_shards > 1) {
+      set_shard_tile(eps);
+    } else {
+      set_tile(tile_begin, tile_end);
+    }
+  }
+  if (walk_engine == WalkEngine::kWavefront) {
+    walk_on_sphere_wavefront(maxSteps, eps, n_walks);
+  } else if (walk_engine == WalkEngine::kWorkStealing) {
+    walk_on_sphere_tasks(maxSteps, eps, n_walks);
+  } else {
+    for (int i = 0; i < n_walks; i++) {
+      walk_on_sphere_single_step(maxSteps, eps);
+    }
   }
 
   // for (auto& Mi : M) Mi = Mi / n_walks;
   // for (auto& mi : m) mi = mi / n_walks;
+}
 
-#pragma omp parallel for
-  for (int i = 0; i < n_mesh_verts; i++) {
-    Mat4d invM = M[i].inverse();
-    Vec4d p;
-    p << mesh_verts(i, 0), mesh_verts(i, 1), mesh_verts(i, 2), 1.;
-    for (int j = 0; j < n_cage_verts; j++) {
-      harmonic_weights(i, j) = p.transpose() * invM * m[i * n_cage_verts + j];
+void StoWarpSolver::walk_on_sphere(int maxSteps, double eps, int n_walks) {
+  ScopedTimer timer("walk_on_sphere");
+  accumulate_walks(maxSteps, eps, n_walks);
+  solve_weights(eps);
+  timer.print();
+}
+
+void StoWarpSolver::solve_weights(double eps) {
+  // Solve row i is written straight to the weights of mesh vertex
+  // first_vert[i], the other vertices welded to it copy that row.
+  ensure_weight_buffer();
+  if (M.empty()) set_tile(tile_begin, tile_end);
+  Vecxi first_vert(n_solve_verts);
+  for (int i = n_mesh_verts - 1; i >= 0; i--) first_vert[solve_row[i]] = i;
+  solve_rows(eps, harmonic_weights, first_vert);
+
+  parallelFor(0, n_solve_verts, [&](int i) {
+    if (mirror_of[i] < 0) return;
+    for (int j = 0; j < n_cage_verts; j++)
+      harmonic_weights(first_vert[i], j) =
+          harmonic_weights(first_vert[mirror_of[i]], cage_mirror[j]);
+  });
+
+  // duplicates take the weights of the vertex they were welded to
+  parallelFor(0, n_mesh_verts, [&](int i) {
+    int first = first_vert[solve_row[i]];
+    if (first != i) harmonic_weights.row(i) = harmonic_weights.row(first);
+  });
+}
+
+void StoWarpSolver::solve_rows(double eps, Eigen::Ref<MatxXd> weights,
+                               const Vecxi& row_of) {
+  // the prior enters as confidence pseudo samples at the vertex itself
+  if (prior_confidence > 0.0) {
+    parallelFor(tile_begin, tile_end, [&](int i) {
+      Vec4d p;
+      p << solve_verts(i, 0), solve_verts(i, 1), solve_verts(i, 2), 1.;
+      M_row(i) += prior_confidence * p * p.transpose();
+      Vec4d* mi = m_row(i);
+      for (int j = 0; j < n_cage_verts; j++) {
+        mi[j] += prior_confidence * prior_weights(i, j) * p;
+      }
+    });
+  }
+
+  // w_ij = p^T M^-1 m_ij = q^T m_ij with q = M^-1 p solved once per vertex,
+  // so the weights of vertex i are its n_cage_verts x 4 block of m times q.
+  // Same rows per worker as the accumulators, the reads of m stay local.
+  parallelForStatic(tile_begin, tile_end, [&](int first, int last) {
+    const int kChunk = 64;
+    Vec4d p[kChunk];
+    Vec4d q[kChunk];
+    bool ok[kChunk];
+    for (int c = first; c < last; c += kChunk) {
+      int count = std::min(kChunk, last - c);
+      for (int k = 0; k < count; k++) {
+        int i = c + k;
+        p[k] << solve_verts(i, 0), solve_verts(i, 1), solve_verts(i, 2), 1.;
+      }
+      choleskySolve4(count, &M_row(c), p, q, ok);
+      for (int k = 0; k < count; k++) {
+        int i = c + k;
+        int row = row_of[i - tile_begin];
+        if (mirror_of[i] >= 0) continue;
+        if (first_radius[i] <= eps || exterior[i]) {
+          set_face_weights(i, weights, row);
+          continue;
+        }
+        // M is singular if all samples of the vertex lie on one plane
+        if (!ok[k]) q[k] = M_row(i).inverse() * p[k];
+        Eigen::Map<const Matx4d> mi(m_row(i)->data(), n_cage_verts, 4);
+        weights.row(row).noalias() = (mi * q[k]).transpose();
+      }
     }
+  });
+}
+
+void StoWarpSolver::smooth_weights(int iterations, double strength,
+                                   SmoothingScheme scheme) {
+  if (n_mesh_verts != meshFn.numVertices()) {
+    MGlobal::displayError("Smoothing needs the weights of every mesh vertex.");
+    return;
+  }
+  Vecxi counts;
+  Vecxi connects;
+  status = getMeshTopology(meshFn, counts, connects);
+  if (status != MS::kSuccess) {
+    MGlobal::displayError("Failed to get mesh vertices.");
+    return;
   }
 
-  harmonic_weights_maya.clear();
-  harmonic_weights_maya.setLength(n_mesh_verts * n_cage_verts);
+  ScopedTimer timer("smooth_weights");
+  ensure_weight_buffer();
+  SparseRowMatd adjacency = buildMeshAdjacency(n_mesh_verts, counts, connects);
+  smoothWeights(harmonic_weights, adjacency, iterations, strength, scheme);
+  timer.print();
+}
 
-  for (int i = 0; i < n_mesh_verts; i++) {
-    for (int j = 0; j < n_cage_verts; j++) {
-      harmonic_weights_maya[i * n_cage_verts + j] = harmonic_weights(i, j);
-    }
+void StoWarpSolver::walk_on_proxy(const ProxyMesh& proxy, int maxSteps,
+                                  double eps, int n_walks,
+                                  int correction_walks) {
+  if (proxy.tris.rows() == 0) {
+    MGlobal::displayError("Proxy mesh has no faces.");
+    status = MS::kFailure;
+    return;
   }
+  std::stringstream ss;
+  ss << "Proxy vertices: " << proxy.verts.rows();
+  MGlobal::displayInfo(ss.str().c_str());
 
+  StoWarpSolver proxy_solver(cageFn, meshFn, proxy.verts);
+  if (proxy_solver.status != MS::kSuccess) {
+    status = proxy_solver.status;
+    return;
+  }
+  proxy_solver.distance_grid = distance_grid;
+  proxy_solver.walk_engine = walk_engine;
+  proxy_solver.deferred_shading = deferred_shading;
+  proxy_solver.float_walks = float_walks;
+  proxy_solver.walk_on_sphere(maxSteps, eps, n_walks);
+
+  ScopedTimer timer("transfer_weights");
+  MatxXd weights =
+      transferWeights(proxy, proxy_solver.harmonic_weights, mesh_verts);
+  timer.print();
+
+  if (correction_walks > 0) {
+    set_prior(weights, n_walks);
+    walk_on_sphere(maxSteps, eps, correction_walks);
+  } else {
+    cache_first_step();
+    classify_vertices(eps);
+    parallelFor(0, n_mesh_verts, [&](int i) {
+      if (exterior[solve_row[i]]) set_face_weights(solve_row[i], weights, i);
+    });
+    ensure_weight_buffer();
+    harmonic_weights = weights;
+  }
+}
+
+void StoWarpSolver::use_distance_grid(int resolution) {
+  ScopedTimer timer("distance_grid");
+  distance_grid = cachedDistanceGrid(cage_bvh, resolution);
   timer.print();
 }
 
+bool StoWarpSolver::use_mirror_symmetry(int axis) {
+  Vecxi counts;
+  Vecxi connects;
+  status = getMeshTopology(cageFn, counts, connects);
+  if (status != MS::kSuccess) {
+    MGlobal::displayError("Failed to get cage vertices.");
+    return false;
+  }
+  double tolerance = kMirrorTolerance * (cage_verts.colwise().maxCoeff() -
+                                         cage_verts.colwise().minCoeff())
+                                            .norm();
+  mirror_plane =
+      findMirrorPlane(cage_verts, counts, connects, axis, tolerance,
+                      cage_mirror);
+  if (mirror_plane.axis < 0) {
+    MGlobal::displayWarning("The cage is not mirror symmetric.");
+    mirror_of.setConstant(-1);
+    return false;
+  }
+  mirror_of = mirrorPartners(solve_verts, mirror_plane, tolerance);
+
+  int n_mirrored = (mirror_of.array() >= 0).count();
+  std::stringstream ss;
+  ss << "Mirror symmetry along " << "xyz"[mirror_plane.axis] << ", walking "
+     << n_solve_verts - n_mirrored << " of " << n_solve_verts << " vertices.";
+  MGlobal::displayInfo(ss.str().c_str());
+  return true;
+}
+
+void StoWarpSolver::set_prior(const MatxXd& weights, double confidence) {
+  // one row per solve vertex, from the first mesh vertex welded to it
+  prior_weights.resize(n_solve_verts, weights.cols());
+  for (int i = n_mesh_verts - 1; i >= 0; i--)
+    prior_weights.row(solve_row[i]) = weights.row(i);
+  prior_confidence = confidence;
+}
+
+void StoWarpSolver::set_weight_buffer(double* data) {
+  if (data) {
+    own_weights.resize(0, 0);
+  } else {
+    own_weights.resize(n_mesh_verts, n_cage_verts);
+    data = own_weights.data();
+  }
+  // rebinds the map, see "Changing the mapped array" in the Eigen docs
+  new (&harmonic_weights)
+      Eigen::Map<MatxXd>(data, n_mesh_verts, n_cage_verts);
+}
+
+void StoWarpSolver::ensure_weight_buffer() {
+  if (harmonic_weights.data() == nullptr) set_weight_buffer(nullptr);
+}
+
+void StoWarpSolver::set_tile(int begin, int end) {
+  tile_begin = begin;
+  tile_end = end;
+  std::vector<Mat4d>().swap(M);
+  std::vector<Vec4d>().swap(m);
+  // The accumulators are first touched by the workers that walk their rows,
+  // so on NUMA machines the pages end up on the node of those workers.
+  M.resize(end - begin);
+  m.resize((size_t)(end - begin) * n_cage_verts);
+  parallelForStatic(begin, end, [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      M_row(i).setZero();
+      Vec4d* mi = m_row(i);
+      for (int j = 0; j < n_cage_verts; j++) mi[j].setZero();
+    }
+  });
+}
+
+// the walk frames, for the engines in other files
+template void StoWarpSolver::walk_frame<double>(Vec3d&, double&) const;
+template void StoWarpSolver::walk_frame<float>(Vec3d&, double&) const;
+
 }  // namespace StWarp
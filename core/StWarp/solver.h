@@ -2,11 +2,52 @@
 #define STWARP_SOLVER_H_
 
 #include "StWarp/type.h"
+#include "StWarp/smoothing.h"
+#include "StWarp/proxy.h"
+#include "StWarp/bvh.h"
+#include "StWarp/distance_grid.h"
+#include "StWarp/cage_face.h"
+#include "StWarp/symmetry.h"
 #include <maya/MFnMesh.h>
-#include <maya/MDoubleArray.h>
+#include <maya/MPointArray.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
 
 namespace StWarp {
 
+// n x 3 points with a row stride, read in place from the caller's memory
+using PointsView = Eigen::Map<const Matx3d, 0, Eigen::OuterStride<>>;
+// x, y, z of the points of a maya array, valid while the array lives
+PointsView pointsView(const MPointArray& points);
+// n x 3 points of a matrix with 3 columns
+PointsView pointsView(const MatxXd& points);
+
+// world space vertex positions of a maya mesh
+MStatus getMeshPoints(MFnMesh& fn, MatxXd& points);
+// faceCounts and faceConnects of a maya mesh
+MStatus getMeshTopology(MFnMesh& fn, Vecxi& face_counts, Vecxi& face_connects);
+
+enum class WalkEngine {
+  // one walk per vertex and thread at a time
+  kPerVertex,
+  // batches of walks advanced step by step, see wavefront.cpp
+  kWavefront,
+  // tasks of a few walks of a block of vertices, balanced by work stealing,
+  // see tasks.cpp
+  kWorkStealing
+};
+
+// Walked solve vertices per task of the wavefront and work stealing
+// engines, consecutive in Morton order. The walks of a task accumulate into
+// its own vertices only. Shards and tiles are whole blocks, so a block walks
+// the same in any of them.
+const int kWalkBlockSize = 64;
+
+struct TerminalBuffer;
+
 struct StoWarpSolver {
   int n_mesh_verts;
   int n_cage_verts;
@@ -14,37 +55,246 @@ struct StoWarpSolver {
   int n_tri_faces;
   int n_quad_faces;
   MatxXd mesh_verts;
+  // Unique mesh positions in Morton order, coincident vertices such as UV
+  // seam splits are welded and solved once. Mesh vertex i is
+  // solve_verts.row(solve_row[i]).
+  // M, m, the first step cache and exterior are per solve vertex.
+  int n_solve_verts;
+  MatxXd solve_verts;
+  Vecxi solve_row;
   MatxXd cage_verts;
   Matx3i tri_faces;
   Matx4i quad_faces;
   MFnMesh& cageFn;
   MFnMesh& meshFn;
+  // Sums of the walks of the solve vertices [tile_begin, tile_end), see
+  // M_row and m_row. Allocated on first use for all solve vertices, or for
+  // the rows of shard, unless set_tile picked a tile.
+  int tile_begin = 0;
+  int tile_end = 0;
   std::vector<Mat4d> M;
   std::vector<Vec4d> m;
-  MatxXd harmonic_weights;
+  // n_mesh_verts x n_cage_verts, row major like the stweights attribute.
+  // Maps own_weights unless set_weight_buffer pointed it at caller memory,
+  // which is allocated when the weights are first written.
+  Eigen::Map<MatxXd> harmonic_weights{nullptr, 0, 0};
+  MatxXd own_weights;
 
-  MDoubleArray harmonic_weights_maya;
+  // weights known beforehand, e.g. transferred from a proxy, blended into the
+  // walk estimate as if they came from prior_confidence walks, per solve
+  // vertex
+  MatxXd prior_weights;
+  double prior_confidence = 0.0;
 
   MStatus status;
 
+  WalkEngine walk_engine = WalkEngine::kPerVertex;
+  // Wavefront engine only: the terminal points of the walks are collected
+  // per block and shaded face by face, see TerminalBuffer.
+  bool deferred_shading = false;
+  // Wavefront and work stealing engines: walk positions and radii in float,
+  // in a frame where the cage fits in the unit ball, so they are as precise
+  // relative to the cage anywhere in world space. M and m are still summed
+  // in double. Walks end no closer to the cage than float resolves, see
+  // walk_eps. Experimental, it is not faster end to end.
+  bool float_walks = false;
+  // walks per vertex run so far, numbers the random streams of the walks
+  long long n_walks_done = 0;
+  // Wavefront engine: the walked vertices are split into n_shards runs of
+  // whole walk blocks and only run shard is walked, see set_shard_tile. A
+  // block walks the same in a shard as in a single solver, so the merged
+  // sums are the same.
+  int shard = 0;
+  int n_shards = 1;
+
+  // closest point query at every mesh vertex, shared by the first step of
+  // all walks starting there
+  Vecxd first_radius;
+  Vecxd first_other;
+  Matx3d first_closest;
+  Vecxi first_face;
+
+  // 1 for solve vertices outside the cage, their weights are those of the
+  // closest point on the cage instead of a walk estimate. n_exterior counts
+  // mesh vertices.
+  Vecxi exterior;
+  int n_exterior = 0;
+
+  // Optional mirror symmetry of mesh and cage. mirror_of[i] >= 0 if solve
+  // vertex i is the mirror image of solve vertex mirror_of[i], it is not
+  // walked and takes the weights of its partner with the cage columns
+  // permuted by cage_mirror.
+  MirrorPlane mirror_plane;
+  Vecxi cage_mirror;
+  Vecxi mirror_of;
+
   // index in tri_faces and quad_faces
   Vecxi face_idx;
 
   // 0: triangle, 1: quad
   Vecxi face_type;
 
+  // precomputed geometry of every cage face
+  CageFaces faces;
+
+  // cage faces as triangles, grouped by face. Triangles of face i are
+  // [face_tri_start[i], face_tri_start[i + 1]) in cage_bvh.tris.
+  TriangleBVH cage_bvh;
+  Vecxi face_tri_start;
+
+  // optional conservative distance field, most steps far from the cage only
+  // need a lookup
+  std::shared_ptr<const DistanceGrid> distance_grid;
+
   StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn);
+  // solve on points instead of the vertices of meshFn
+  StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn, const MatxXd& points);
+  StoWarpSolver(MFnMesh& cageFn, MFnMesh& meshFn, const PointsView& points);
+  void init(const PointsView& points);
+
+  // The weights are written to data, n_mesh_verts * n_cage_verts doubles
+  // that must stay valid while the solver runs, e.g. the array of the
+  // attribute data they end up in. nullptr for a buffer of the solver.
+  void set_weight_buffer(double* data);
+  // own_weights unless a buffer was set
+  void ensure_weight_buffer();
+
+  // M and m of solve vertex i, which must be in the tile
+  Mat4d& M_row(int i) { return M[i - tile_begin]; }
+  Vec4d* m_row(int i) {
+    return &m[(size_t)(i - tile_begin) * n_cage_verts];
+  }
+  // Zeroed M and m for the solve vertices [begin, end), the sums of the
+  // previous tile are freed.
+  void set_tile(int begin, int end);
 
   double closest_point_on_cage(const Vec3d& input_p, Vec3d& closest_point,
                                int& face_idx);
+  // face_idx is the seed face on input (-1 for none), other_bound a lower
+  // bound of the distance to all other faces on output
+  double closest_point_on_cage(const Vec3d& input_p, Vec3d& closest_point,
+                               int& face_idx, double& other_bound);
+  // Distance only query for sizing the spheres. face_idx is the seed face on
+  // input and a face within stop of input_p, or else the closest face, on
+  // output.
+  double distance_to_cage(const Vec3d& input_p, int& face_idx,
+                          double& other_bound, double stop);
 
   Vec3d get_tri_barycentric(const Vec3d& p, const int face_idx);
   Vec3d tri_interpolate(const Vec3d& w, const int face_idx);
   Vec4d get_quad_barycentric(const Vec3d& p, const int face_idx);
   Vec3d quad_interpolate(const Vec4d& w, const int face_idx);
 
+  void cache_first_step();
+  // winding number test of the mesh vertices off the cage, needs
+  // cache_first_step
+  void classify_vertices(double eps);
+  // weights of the closest point on the cage of solve vertex i, written to
+  // the given row of weights
+  void set_face_weights(int i, Eigen::Ref<MatxXd> weights, int row);
+  // one walk of every vertex
   void walk_on_sphere_single_step(int maxSteps, double eps);
+  void single_step_walk(int i, int maxSteps, double eps);
+  // All n_walks walks of every vertex, advanced in wavefronts of many walks
+  // in structure of arrays layout. Terminated walks are compacted out and
+  // their slots refilled, so a step runs over dense live walks however the
+  // walk lengths vary.
+  void walk_on_sphere_wavefront(int maxSteps, double eps, int n_walks);
+  // the wavefront engine with walk positions in Scalar
+  template <typename Scalar>
+  void wavefront_walks(int maxSteps, double eps, int n_walks);
+  // All n_walks walks of every vertex as tasks of one vertex block and a
+  // batch of walks, spread over the threads by TaskRanges. Every thread sums
+  // into its own accumulators, so there is no barrier between walks.
+  void walk_on_sphere_tasks(int maxSteps, double eps, int n_walks);
+  template <typename Scalar>
+  void task_walks(int maxSteps, double eps, int n_walks);
+  // Walk positions in Scalar are world = origin + scale * local, the
+  // identity for double and the normalized cage frame for float.
+  template <typename Scalar>
+  void walk_frame(Vec3d& origin, double& scale) const;
+  // World distance to the cage at which the walks end: eps, but no less
+  // than a few ulps of Scalar in the walk frame, which float walks could
+  // not resolve and would walk on up to maxSteps.
+  template <typename Scalar>
+  static double walk_eps(double eps, double scale) {
+    return std::max(eps, 8 * std::numeric_limits<Scalar>::epsilon() * scale);
+  }
+  // World distance d in the walk frame, rounded toward zero like the
+  // DistanceGrid values, so a sphere radius or bound in Scalar is never
+  // larger than the one proven in world space.
+  template <typename Scalar>
+  static Scalar walk_local(double d, double scale) {
+    double x = std::min(d / scale, (double)std::numeric_limits<Scalar>::max());
+    Scalar r = Scalar(x);
+    if (r > x) r = std::nextafter(r, Scalar(0));
+    return r;
+  }
+  // Blocks of block_size of the walked solve vertices split over n_workers
+  // along the rows each worker zeroed in set_tile, share_begin of TaskRanges.
+  std::vector<int> block_shares(const std::vector<int>& walked,
+                                int block_size, int n_workers) const;
+  // Solve vertices of the tile with walks, i.e. not on or outside the cage
+  // and not mirrored.
+  std::vector<int> walked_vertices(double eps) const;
+  // Radius of the next sphere at p, from the cheapest of the distance grid,
+  // the tracked face fi with other_bound and a cage query that is large
+  // enough. Below eps the walk ends on face fi.
+  double sphere_radius(const Vec3d& p, int& fi, double& other_bound,
+                       double eps);
+  // adds the walk of solve vertex i ending at p near face fi to M and m
+  void accumulate_sample(int i, const Vec3d& p, int fi);
+  // same into the given sums, mi has n_cage_verts entries
+  void accumulate_sample(const Vec3d& p, int fi, Mat4d& Mi, Vec4d* mi);
+  // accumulate_sample of all terminal points in the buffer, which is
+  // cleared
+  void shade_terminals(TerminalBuffer& terminals);
+  // n_walks walks of every walked vertex summed into M and m
+  void accumulate_walks(int maxSteps, double eps, int n_walks);
+  // the walks alone, needs classify_vertices
+  void run_walks(int maxSteps, double eps, int n_walks);
+  // harmonic_weights from M, m and the prior, needs classify_vertices
+  void solve_weights(double eps);
+  // Weights of the walked, on cage and exterior solve vertices i of the
+  // tile, to row row_of[i - tile_begin] of weights. Mirrored ones are left
+  // to the caller.
+  void solve_rows(double eps, Eigen::Ref<MatxXd> weights,
+                  const Vecxi& row_of);
+  // accumulate_walks and solve_weights
   void walk_on_sphere(int maxSteps, double eps, int n_walks);
+
+  // Tile from the first to the last walked vertex of shard, so a shard run
+  // holds only its own sums.
+  void set_shard_tile(double eps);
+  // M and m of the vertices of shard, written to a file for merge_shards
+  void save_shard(const std::string& path);
+  // Sums the files of all shards of the same binding and solves the
+  // weights, as walk_on_sphere would with the walks of every shard.
+  void merge_shards(const std::vector<std::string>& paths, double eps);
+
+  // Walks on a coarse proxy of the mesh, the weights are transferred to the
+  // mesh vertices and optionally refined with correction_walks walks.
+  void walk_on_proxy(const ProxyMesh& proxy, int maxSteps, double eps,
+                     int n_walks, int correction_walks);
+  // weights: one row per mesh vertex
+  void set_prior(const MatxXd& weights, double confidence);
+  // resolution: grid cells along the longest side of the cage
+  void use_distance_grid(int resolution);
+  // axis 0, 1, 2 for the x, y, z plane through the cage center, -1 to detect
+  // it. Returns false and solves every vertex if the cage is not symmetric.
+  bool use_mirror_symmetry(int axis);
+
+  // Out of core solve for weights larger than memory: the solve vertices
+  // are walked and solved in tiles of about memory_budget bytes of sums and
+  // weights. Every tile's weights go to the weight file at path once it is
+  // solved, then its sums are freed. harmonic_weights is not used.
+  void solve_to_file(const std::string& path, int maxSteps, double eps,
+                     int n_walks, size_t memory_budget);
+
+  // Laplacian smoothing of harmonic_weights over the edge graph of the mesh.
+  void smooth_weights(int iterations, double strength,
+                      SmoothingScheme scheme);
+
 };
 
 }  // namespace StWarp
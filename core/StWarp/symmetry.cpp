@@ -0,0 +1,81 @@
+#include "StWarp/symmetry.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "StWarp/parallel.h"
+#include "StWarp/weld.h"
+
+namespace StWarp {
+
+Vec3d mirrorPoint(const Vec3d& p, const MirrorPlane& plane) {
+  Vec3d q = p;
+  q(plane.axis) = 2.0 * plane.offset - p(plane.axis);
+  return q;
+}
+
+Vecxi mirrorCage(const MatxXd& verts, const Vecxi& face_counts,
+                 const Vecxi& face_connects, const MirrorPlane& plane,
+                 double tolerance) {
+  int n_verts = verts.rows();
+  PointHash hash(verts, tolerance);
+  for (int i = 0; i < n_verts; i++) hash.add(i);
+  Vecxi mirror(n_verts);
+  for (int i = 0; i < n_verts; i++) {
+    mirror[i] = hash.find(mirrorPoint(verts.row(i).transpose(), plane));
+    if (mirror[i] < 0) return Vecxi();
+  }
+
+  std::set<std::vector<int>> faces;
+  int offset = 0;
+  for (int f = 0; f < face_counts.size(); f++) {
+    std::vector<int> face(face_connects.data() + offset,
+                          face_connects.data() + offset + face_counts[f]);
+    std::sort(face.begin(), face.end());
+    faces.insert(face);
+    offset += face_counts[f];
+  }
+  for (const std::vector<int>& face : faces) {
+    std::vector<int> mirrored;
+    for (int v : face) mirrored.push_back(mirror[v]);
+    std::sort(mirrored.begin(), mirrored.end());
+    if (!faces.count(mirrored)) return Vecxi();
+  }
+  return mirror;
+}
+
+MirrorPlane findMirrorPlane(const MatxXd& verts, const Vecxi& face_counts,
+                            const Vecxi& face_connects, int axis,
+                            double tolerance, Vecxi& cage_mirror) {
+  Vec3d center = 0.5 * (verts.colwise().minCoeff() + verts.colwise().maxCoeff())
+                           .transpose();
+  for (int a = 0; a < 3; a++) {
+    if (axis >= 0 && a != axis) continue;
+    MirrorPlane plane;
+    plane.axis = a;
+    plane.offset = center(a);
+    cage_mirror = mirrorCage(verts, face_counts, face_connects, plane,
+                             tolerance);
+    if (cage_mirror.size() > 0) return plane;
+  }
+  cage_mirror.resize(0);
+  return MirrorPlane();
+}
+
+Vecxi mirrorPartners(const MatxXd& points, const MirrorPlane& plane,
+                     double tolerance) {
+  int n_points = points.rows();
+  PointHash hash(points, tolerance);
+  for (int i = 0; i < n_points; i++) {
+    if (points(i, plane.axis) > plane.offset + tolerance) hash.add(i);
+  }
+  Vecxi partner = Vecxi::Constant(n_points, -1);
+  parallelFor(0, n_points, [&](int i) {
+    if (points(i, plane.axis) >= plane.offset - tolerance) return;
+    partner[i] = hash.find(mirrorPoint(points.row(i).transpose(), plane));
+  });
+  return partner;
+}
+
+}  // namespace StWarp
@@ -0,0 +1,38 @@
+#ifndef STWARP_SYMMETRY_H_
+#define STWARP_SYMMETRY_H_
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+// The plane x_axis = offset.
+struct MirrorPlane {
+  int axis = -1;
+  double offset = 0.0;
+};
+
+Vec3d mirrorPoint(const Vec3d& p, const MirrorPlane& plane);
+
+// Vertex correspondence of a cage mirrored on plane, or an empty vector if
+// the cage is not symmetric: every vertex needs a mirrored vertex within
+// tolerance and every face a mirrored face.
+Vecxi mirrorCage(const MatxXd& verts, const Vecxi& face_counts,
+                 const Vecxi& face_connects, const MirrorPlane& plane,
+                 double tolerance);
+
+// Tries the axis aligned planes through the bounding box center of the
+// cage, or only the plane of the given axis if axis >= 0. Returns the first
+// one the cage is symmetric to and sets cage_mirror, axis is -1 if none.
+MirrorPlane findMirrorPlane(const MatxXd& verts, const Vecxi& face_counts,
+                            const Vecxi& face_connects, int axis,
+                            double tolerance, Vecxi& cage_mirror);
+
+// For every point on the negative side of plane, the index of the point at
+// its mirrored position within tolerance, otherwise -1. Points on the plane
+// or without a partner are -1 and have to be solved themselves.
+Vecxi mirrorPartners(const MatxXd& points, const MirrorPlane& plane,
+                     double tolerance);
+
+}  // namespace StWarp
+
+#endif  // STWARP_SYMMETRY_H_
@@ -0,0 +1,190 @@
+#include "StWarp/tasks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "StWarp/parallel.h"
+#include "StWarp/rng.h"
+#include "StWarp/solver.h"
+
+namespace StWarp {
+
+namespace {
+
+// walks per vertex per task
+const int kWalkBatch = 16;
+
+}  // namespace
+
+TaskRanges::TaskRanges(int n_tasks, int n_workers)
+    : n_workers_(n_workers), shares_(new Share[n_workers]) {
+  for (int w = 0; w < n_workers; w++) {
+    uint32_t first = (long long)n_tasks * w / n_workers;
+    uint32_t last = (long long)n_tasks * (w + 1) / n_workers;
+    shares_[w].bounds.store(pack(first, last), std::memory_order_relaxed);
+  }
+}
+
+TaskRanges::TaskRanges(const std::vector<int>& share_begin)
+    : n_workers_(share_begin.size() - 1), shares_(new Share[n_workers_]) {
+  for (int w = 0; w < n_workers_; w++) {
+    shares_[w].bounds.store(pack(share_begin[w], share_begin[w + 1]),
+                            std::memory_order_relaxed);
+  }
+}
+
+int TaskRanges::next(int worker) {
+  // own share, front first
+  std::atomic<uint64_t>& own = shares_[worker].bounds;
+  uint64_t bounds = own.load(std::memory_order_acquire);
+  while (front(bounds) < back(bounds)) {
+    if (own.compare_exchange_weak(bounds,
+                                  pack(front(bounds) + 1, back(bounds)),
+                                  std::memory_order_acq_rel))
+      return front(bounds);
+  }
+
+  // steal from the largest share
+  while (true) {
+    int victim = -1;
+    uint32_t largest = 0;
+    for (int w = 0; w < n_workers_; w++) {
+      uint64_t b = shares_[w].bounds.load(std::memory_order_relaxed);
+      if (back(b) > front(b) && back(b) - front(b) > largest) {
+        largest = back(b) - front(b);
+        victim = w;
+      }
+    }
+    if (victim < 0) return -1;
+
+    std::atomic<uint64_t>& other = shares_[victim].bounds;
+    bounds = other.load(std::memory_order_acquire);
+    if (front(bounds) >= back(bounds)) continue;
+    uint32_t mid = front(bounds) + (back(bounds) - front(bounds)) / 2;
+    if (!other.compare_exchange_strong(bounds, pack(front(bounds), mid),
+                                       std::memory_order_acq_rel))
+      continue;
+    // [mid, back) is ours now, run mid and keep the rest for later
+    own.store(pack(mid + 1, back(bounds)), std::memory_order_release);
+    return mid;
+  }
+}
+
+std::vector<int> StoWarpSolver::block_shares(const std::vector<int>& walked,
+                                            int block_size,
+                                            int n_workers) const {
+  int n_blocks = (walked.size() + block_size - 1) / block_size;
+  std::vector<int> share_begin(n_workers + 1, n_blocks);
+  for (int w = 0; w < n_workers; w++) {
+    int row = shareBegin(tile_begin, tile_end, w, n_workers);
+    int first = std::lower_bound(walked.begin(), walked.end(), row) -
+                walked.begin();
+    share_begin[w] = std::min((first + block_size / 2) / block_size, n_blocks);
+  }
+  share_begin[0] = 0;
+  return share_begin;
+}
+
+void StoWarpSolver::walk_on_sphere_tasks(int maxSteps, double eps,
+                                         int n_walks) {
+  if (!float_walks) return task_walks<double>(maxSteps, eps, n_walks);
+  return task_walks<float>(maxSteps, eps, n_walks);
+}
+
+template <typename Scalar>
+void StoWarpSolver::task_walks(int maxSteps, double eps, int n_walks) {
+  using Vec3 = Eigen::Matrix<Scalar, 3, 1>;
+  std::vector<int> walked = walked_vertices(eps);
+  int n_walked = walked.size();
+  int n_blocks = (n_walked + kWalkBlockSize - 1) / kWalkBlockSize;
+  int n_batches = (n_walks + kWalkBatch - 1) / kWalkBatch;
+  const long long first_walk = n_walks_done;
+
+  // task t is batch t % n_batches of block t / n_batches, the batches of a
+  // block are neighbors in a share and reuse its accumulators. Workers start
+  // on the blocks of the rows they first touched.
+  std::vector<std::mutex> block_locks(n_blocks);
+  int n_workers = parallelThreads();
+  std::vector<int> share_begin =
+      block_shares(walked, kWalkBlockSize, n_workers);
+  for (int& begin : share_begin) begin *= n_batches;
+  TaskRanges ranges(share_begin);
+
+  // walks are in the frame of Scalar, the cage queries in world space
+  Vec3d origin;
+  double scale;
+  walk_frame<Scalar>(origin, scale);
+  const double end_eps = walk_eps<Scalar>(eps, scale);
+  const Scalar local_eps = end_eps / scale;
+
+  parallelWorkers(n_workers, [&](int worker, int) {
+    // this thread's sums for block local_block, added to M and m under the
+    // block lock when the thread moves on to another block
+    int local_block = -1;
+    std::vector<Mat4d> local_M(kWalkBlockSize, Mat4d::Zero());
+    std::vector<Vec4d> local_m(kWalkBlockSize * n_cage_verts, Vec4d::Zero());
+    auto flush = [&]() {
+      if (local_block < 0) return;
+      int begin = local_block * kWalkBlockSize;
+      int end = std::min(begin + kWalkBlockSize, n_walked);
+      std::lock_guard<std::mutex> lock(block_locks[local_block]);
+      for (int b = 0; b < end - begin; b++) {
+        int i = walked[begin + b];
+        M_row(i) += local_M[b];
+        local_M[b].setZero();
+        Vec4d* mi = m_row(i);
+        for (int j = 0; j < n_cage_verts; j++) {
+          mi[j] += local_m[b * n_cage_verts + j];
+          local_m[b * n_cage_verts + j].setZero();
+        }
+      }
+    };
+
+    for (int t = ranges.next(worker); t >= 0; t = ranges.next(worker)) {
+      int block = t / n_batches;
+      int batch = t % n_batches;
+      if (block != local_block) {
+        flush();
+        local_block = block;
+      }
+      int begin = block * kWalkBlockSize;
+      int end = std::min(begin + kWalkBlockSize, n_walked);
+      int walk_end = std::min((batch + 1) * kWalkBatch, n_walks);
+      for (int b = 0; b < end - begin; b++) {
+        int i = walked[begin + b];
+        for (int w = batch * kWalkBatch; w < walk_end; w++) {
+          // same walk as in the wavefront engine, radius and bound in the
+          // walk frame
+          uint64_t key = walkKey(i, first_walk + w);
+          Vec3 mp = ((solve_verts.row(i).transpose() - origin) / scale)
+                        .cast<Scalar>();
+          Scalar R = walk_local<Scalar>(first_radius[i], scale);
+          Scalar other = walk_local<Scalar>(first_other[i], scale);
+          int fi = first_face[i];
+          int steps = 1;
+          while (R > local_eps && steps < maxSteps) {
+            Vec3 dir;
+            uniformDirection(key, 2 * steps, dir(0), dir(1), dir(2));
+            mp += R * dir;
+            other -= R;
+            steps++;
+            double bound = scale * other;
+            R = walk_local<Scalar>(
+                sphere_radius(origin + scale * mp.template cast<double>(), fi,
+                              bound, end_eps),
+                scale);
+            other = walk_local<Scalar>(bound, scale);
+          }
+          accumulate_sample(origin + scale * mp.template cast<double>(), fi,
+                            local_M[b], &local_m[b * n_cage_verts]);
+        }
+      }
+    }
+    flush();
+  });
+  n_walks_done += n_walks;
+}
+
+}  // namespace StWarp
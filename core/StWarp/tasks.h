@@ -0,0 +1,42 @@
+#ifndef STWARP_TASKS_H_
+#define STWARP_TASKS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace StWarp {
+
+// Work stealing over a fixed set of tasks [0, n_tasks). Every worker starts
+// with an even contiguous share and takes tasks from its front. A worker
+// whose share is empty steals the back half of the largest other share, so
+// workers stuck with long tasks are relieved without a barrier. Shares are
+// packed (front, back) pairs updated by compare and swap.
+class TaskRanges {
+ public:
+  TaskRanges(int n_tasks, int n_workers);
+  // worker w starts with [share_begin[w], share_begin[w + 1])
+  explicit TaskRanges(const std::vector<int>& share_begin);
+
+  // Next task of worker, -1 once no share has tasks left.
+  int next(int worker);
+
+ private:
+  struct alignas(64) Share {
+    std::atomic<uint64_t> bounds;
+  };
+
+  static uint64_t pack(uint32_t front, uint32_t back) {
+    return (uint64_t)front << 32 | back;
+  }
+  static uint32_t front(uint64_t bounds) { return bounds >> 32; }
+  static uint32_t back(uint64_t bounds) { return (uint32_t)bounds; }
+
+  int n_workers_;
+  std::unique_ptr<Share[]> shares_;
+};
+
+}  // namespace StWarp
+
+#endif  // STWARP_TASKS_H_
@@ -0,0 +1,142 @@
+#include <maya/MGlobal.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "StWarp/solver.h"
+#include "StWarp/timer.h"
+
+namespace StWarp {
+
+namespace {
+
+// Weight file: a WeightFileHeader, then the n_mesh_verts x n_cage_verts
+// weights as doubles, row major like the stweights attribute, in native
+// byte order.
+const char kWeightMagic[4] = {'S', 'T', 'W', 'W'};
+const int32_t kWeightVersion = 1;
+
+struct WeightFileHeader {
+  char magic[4];
+  int32_t version;
+  int64_t n_mesh_verts;
+  int64_t n_cage_verts;
+};
+
+}  // namespace
+
+void StoWarpSolver::solve_to_file(const std::string& path, int maxSteps,
+                                  double eps, int n_walks,
+                                  size_t memory_budget) {
+  ScopedTimer timer("solve_to_file");
+  auto fail = [&]() {
+    MGlobal::displayError(("Failed to write weight file " + path).c_str());
+    status = MS::kFailure;
+  };
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary |
+                              std::ios::trunc);
+  WeightFileHeader header;
+  std::memcpy(header.magic, kWeightMagic, sizeof(kWeightMagic));
+  header.version = kWeightVersion;
+  header.n_mesh_verts = n_mesh_verts;
+  header.n_cage_verts = n_cage_verts;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!file) return fail();
+  const std::streamoff row_bytes = n_cage_verts * sizeof(double);
+  auto row_offset = [&](int v) {
+    return (std::streamoff)sizeof(header) + v * row_bytes;
+  };
+
+  cache_first_step();
+  classify_vertices(eps);
+
+  // mesh vertices of solve vertex i are mesh_of[mesh_start[i]] up to
+  // mesh_of[mesh_start[i + 1]]
+  Vecxi mesh_start = Vecxi::Zero(n_solve_verts + 1);
+  for (int v = 0; v < n_mesh_verts; v++) mesh_start[solve_row[v] + 1]++;
+  for (int i = 0; i < n_solve_verts; i++) mesh_start[i + 1] += mesh_start[i];
+  Vecxi mesh_of(n_mesh_verts);
+  Vecxi next = mesh_start.head(n_solve_verts);
+  for (int v = 0; v < n_mesh_verts; v++) mesh_of[next[solve_row[v]]++] = v;
+
+  // M, m and the weights of one solve vertex of a tile
+  const size_t tile_row_bytes =
+      sizeof(Mat4d) + n_cage_verts * (sizeof(Vec4d) + sizeof(double));
+  const long long max_rows =
+      std::max<long long>(1, memory_budget / tile_row_bytes);
+
+  tile_begin = 0;
+  tile_end = n_solve_verts;
+  std::vector<int> walked = walked_vertices(eps);
+  const long long first_walk = n_walks_done;
+  int n_tiles = 0;
+  int largest_tile = 0;
+  for (int begin = 0; begin < n_solve_verts; n_tiles++) {
+    // Tiles end between walk blocks, so every block walks as it would in
+    // memory. A block too large for the budget is a tile of its own.
+    int end = std::min<long long>(begin + max_rows, n_solve_verts);
+    int n_before =
+        std::lower_bound(walked.begin(), walked.end(), end) - walked.begin();
+    int block_first = n_before - n_before % kWalkBlockSize;
+    if (end < n_solve_verts && block_first < n_before) {
+      if (walked[block_first] > begin) {
+        end = walked[block_first];
+      } else {
+        int block_last =
+            std::min<int>(block_first + kWalkBlockSize, walked.size()) - 1;
+        end = walked[block_last] + 1;
+      }
+    }
+    largest_tile = std::max(largest_tile, end - begin);
+
+    set_tile(begin, end);
+    n_walks_done = first_walk;
+    run_walks(maxSteps, eps, n_walks);
+    MatxXd weights(end - begin, n_cage_verts);
+    solve_rows(eps, weights, Vecxi::LinSpaced(end - begin, 0, end - begin - 1));
+
+    // every mesh vertex welded to a solved vertex gets its row
+    for (int i = begin; i < end; i++) {
+      if (mirror_of[i] >= 0) continue;
+      for (int k = mesh_start[i]; k < mesh_start[i + 1]; k++) {
+        file.seekp(row_offset(mesh_of[k]));
+        file.write(reinterpret_cast<const char*>(weights.row(i - begin).data()),
+                   row_bytes);
+      }
+    }
+    if (!file) return fail();
+    begin = end;
+  }
+  std::vector<Mat4d>().swap(M);
+  std::vector<Vec4d>().swap(m);
+  tile_begin = 0;
+  tile_end = n_solve_verts;
+
+  // mirrored vertices take the permuted row of their partner, which may be
+  // in any tile, so it is read back from the file
+  Vecxd partner(n_cage_verts);
+  Vecxd row(n_cage_verts);
+  for (int i = 0; i < n_solve_verts; i++) {
+    if (mirror_of[i] < 0) continue;
+    file.seekg(row_offset(mesh_of[mesh_start[mirror_of[i]]]));
+    file.read(reinterpret_cast<char*>(partner.data()), row_bytes);
+    for (int j = 0; j < n_cage_verts; j++) row[j] = partner[cage_mirror[j]];
+    for (int k = mesh_start[i]; k < mesh_start[i + 1]; k++) {
+      file.seekp(row_offset(mesh_of[k]));
+      file.write(reinterpret_cast<const char*>(row.data()), row_bytes);
+    }
+  }
+  file.close();
+  if (!file) return fail();
+
+  std::stringstream ss;
+  ss << "Weights written to " << path << " in " << n_tiles
+     << " tiles of at most " << largest_tile << " vertices.";
+  MGlobal::displayInfo(ss.str().c_str());
+  timer.print();
+}
+
+}  // namespace StWarp
@@ -13,6 +13,7 @@ using MatxXf =
     Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
 using Matx2d = Eigen::Matrix<double, Eigen::Dynamic, 2, Eigen::RowMajor>;
 using Matx3d = Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
+using Matx4d = Eigen::Matrix<double, Eigen::Dynamic, 4, Eigen::RowMajor>;
 using MatxXd =
     Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
 using Matx2i = Eigen::Matrix<int, Eigen::Dynamic, 2, Eigen::RowMajor>;
@@ -53,6 +54,7 @@ using Listx3d = std::vector<Vec3d>;
 using Listx2d = std::vector<Vec2d>;
 using SparseMatf = Eigen::SparseMatrix<float>;
 using SparseMatd = Eigen::SparseMatrix<double>;
+using SparseRowMatd = Eigen::SparseMatrix<double, Eigen::RowMajor>;
 using SparseVecd = Eigen::SparseVector<double>;
 using Tripletf = Eigen::Triplet<float>;
 using Tripletd = Eigen::Triplet<double>;
@@ -0,0 +1,215 @@
+#include "StWarp/wavefront.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "StWarp/cpu_dispatch.h"
+#include "StWarp/parallel.h"
+#include "StWarp/rng.h"
+#include "StWarp/solver.h"
+#include "StWarp/tasks.h"
+
+namespace StWarp {
+
+namespace {
+
+// live walks per wavefront
+const int kFrontSize = 1024;
+
+// moves walks [0, n) to a random point of their spheres
+STWARP_KERNEL
+void moveWalks(int n, const uint64_t* key, int* steps, double* x, double* y,
+               double* z, const double* radius, double* other) {
+#pragma omp simd
+  for (int k = 0; k < n; k++) {
+    double dx, dy, dz;
+    uniformDirection(key[k], 2 * steps[k], dx, dy, dz);
+    x[k] += radius[k] * dx;
+    y[k] += radius[k] * dy;
+    z[k] += radius[k] * dz;
+    other[k] -= radius[k];
+    steps[k]++;
+  }
+}
+
+// same in float, twice the walks per vector
+STWARP_KERNEL
+void moveWalks(int n, const uint64_t* key, int* steps, float* x, float* y,
+               float* z, const float* radius, float* other) {
+#pragma omp simd
+  for (int k = 0; k < n; k++) {
+    float dx, dy, dz;
+    uniformDirection(key[k], 2 * steps[k], dx, dy, dz);
+    x[k] += radius[k] * dx;
+    y[k] += radius[k] * dy;
+    z[k] += radius[k] * dz;
+    other[k] -= radius[k];
+    steps[k]++;
+  }
+}
+
+}  // namespace
+
+void TerminalBuffer::add(int i, int fi, double px, double py, double pz) {
+  vertex.push_back(i);
+  face.push_back(fi);
+  x.push_back(px);
+  y.push_back(py);
+  z.push_back(pz);
+}
+
+void TerminalBuffer::sort_by_face(int n_faces) {
+  int n = vertex.size();
+  face_start.assign(n_faces + 1, 0);
+  for (int k = 0; k < n; k++) face_start[face[k] + 1]++;
+  for (int f = 0; f < n_faces; f++) face_start[f + 1] += face_start[f];
+  sorted_vertex.resize(n);
+  sorted_x.resize(n);
+  sorted_y.resize(n);
+  sorted_z.resize(n);
+  weights.resize(4 * n);
+  // face_start[f] is advanced past the points of face f, then restored
+  for (int k = 0; k < n; k++) {
+    int s = face_start[face[k]]++;
+    sorted_vertex[s] = vertex[k];
+    sorted_x[s] = x[k];
+    sorted_y[s] = y[k];
+    sorted_z[s] = z[k];
+  }
+  for (int f = n_faces; f > 0; f--) face_start[f] = face_start[f - 1];
+  face_start[0] = 0;
+}
+
+void TerminalBuffer::clear() {
+  vertex.clear();
+  face.clear();
+  x.clear();
+  y.clear();
+  z.clear();
+}
+
+void StoWarpSolver::shade_terminals(TerminalBuffer& terminals) {
+  if (terminals.vertex.empty()) return;
+  terminals.sort_by_face(n_cage_faces);
+  for (int f = 0; f < n_cage_faces; f++) {
+    int first = terminals.face_start[f];
+    int count = terminals.face_start[f + 1] - first;
+    if (count == 0) continue;
+    const CageFace& face = faces[f];
+    closestFaceWeights(face, count, &terminals.sorted_x[first],
+                       &terminals.sorted_y[first], &terminals.sorted_z[first],
+                       &terminals.weights[4 * first]);
+    for (int k = first; k < first + count; k++) {
+      int i = terminals.sorted_vertex[k];
+      Vec4d sample_p;
+      sample_p << terminals.sorted_x[k], terminals.sorted_y[k],
+          terminals.sorted_z[k], 1.;
+      M_row(i) += sample_p * sample_p.transpose();
+      const double* w = &terminals.weights[4 * k];
+      Vec4d* mi = m_row(i);
+      for (int j = 0; j < face.n_verts; j++) {
+        mi[face.verts[j]] += w[j] * sample_p;
+      }
+    }
+  }
+  terminals.clear();
+}
+
+void StoWarpSolver::walk_on_sphere_wavefront(int maxSteps, double eps,
+                                             int n_walks) {
+  if (!float_walks) return wavefront_walks<double>(maxSteps, eps, n_walks);
+  return wavefront_walks<float>(maxSteps, eps, n_walks);
+}
+
+template <typename Scalar>
+void StoWarpSolver::wavefront_walks(int maxSteps, double eps, int n_walks) {
+  std::vector<int> walked = walked_vertices(eps);
+  int n_walked = walked.size();
+  const long long first_walk = n_walks_done;
+
+  // blocks of the rows a worker first touched first, then stolen ones
+  int n_workers = parallelThreads();
+  TaskRanges ranges(block_shares(walked, kWalkBlockSize, n_workers));
+
+  // the front is in the frame of Scalar, the cage queries in world space
+  Vec3d origin;
+  double scale;
+  walk_frame<Scalar>(origin, scale);
+  const double end_eps = walk_eps<Scalar>(eps, scale);
+  const Scalar local_eps = end_eps / scale;
+  auto local = [&](double d) { return walk_local<Scalar>(d, scale); };
+
+  parallelWorkers(n_workers, [&](int worker, int) {
+    WalkFront<Scalar> front(kFrontSize);
+    auto world = [&](int k) {
+      return Vec3d(origin(0) + scale * front.x[k],
+                   origin(1) + scale * front.y[k],
+                   origin(2) + scale * front.z[k]);
+    };
+    TerminalBuffer terminals;
+    for (int b = ranges.next(worker); b >= 0; b = ranges.next(worker)) {
+      int begin = b * kWalkBlockSize;
+      int end = std::min(begin + kWalkBlockSize, n_walked);
+      // ticket t is walk t % n_walks of vertex walked[begin + t / n_walks]
+      long long next_ticket = 0;
+      long long n_tickets = (long long)(end - begin) * n_walks;
+      front.size = 0;
+      while (front.size > 0 || next_ticket < n_tickets) {
+        // refill the terminated slots with new walks
+        while (front.size < kFrontSize && next_ticket < n_tickets) {
+          int k = front.size++;
+          int i = walked[begin + next_ticket / n_walks];
+          long long w = first_walk + next_ticket % n_walks;
+          next_ticket++;
+          front.x[k] = Scalar((solve_verts(i, 0) - origin(0)) / scale);
+          front.y[k] = Scalar((solve_verts(i, 1) - origin(1)) / scale);
+          front.z[k] = Scalar((solve_verts(i, 2) - origin(2)) / scale);
+          front.radius[k] = local(first_radius[i]);
+          front.other[k] = local(first_other[i]);
+          front.vertex[k] = i;
+          front.face[k] = first_face[i];
+          front.steps[k] = 1;
+          front.key[k] = walkKey(i, w);
+        }
+
+        // move every walk to a random point of its sphere
+        int n = front.size;
+        Scalar* x = front.x.data();
+        Scalar* y = front.y.data();
+        Scalar* z = front.z.data();
+        Scalar* radius = front.radius.data();
+        Scalar* other = front.other.data();
+        int* steps = front.steps.data();
+        moveWalks(n, front.key.data(), steps, x, y, z, radius, other);
+
+        // next spheres
+        for (int k = 0; k < n; k++) {
+          double bound = scale * other[k];
+          radius[k] =
+              local(sphere_radius(world(k), front.face[k], bound, end_eps));
+          other[k] = local(bound);
+        }
+
+        // accumulate terminated walks and compact the live ones
+        int live = 0;
+        for (int k = 0; k < n; k++) {
+          if (radius[k] > local_eps && steps[k] < maxSteps) {
+            if (live != k) front.move(k, live);
+            live++;
+          } else if (deferred_shading) {
+            Vec3d p = world(k);
+            terminals.add(front.vertex[k], front.face[k], p(0), p(1), p(2));
+          } else {
+            accumulate_sample(front.vertex[k], world(k), front.face[k]);
+          }
+        }
+        front.size = live;
+      }
+      // the terminals are all from vertices of this block
+      shade_terminals(terminals);
+    }
+  });
+  n_walks_done += n_walks;
+}
+
+}  // namespace StWarp
@@ -0,0 +1,73 @@
+#ifndef STWARP_WAVEFRONT_H_
+#define STWARP_WAVEFRONT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "StWarp/type.h"
+#include "StWarp/distance_kernels.h"
+
+namespace StWarp {
+
+// Live walks of a wavefront in structure of arrays layout, walk k is at
+// (x[k], y[k], z[k]) with the next sphere of radius[k]. vertex is the solve
+// vertex it started from, face and other the tracked face and the bound of
+// the other faces, key its random stream. Positions and radii are Scalar,
+// double or float.
+template <typename Scalar>
+struct WalkFront {
+  using Lanes = std::vector<Scalar, Eigen::aligned_allocator<Scalar>>;
+
+  int size = 0;
+  Lanes x, y, z, radius, other;
+  std::vector<int> vertex, face, steps;
+  std::vector<uint64_t> key;
+
+  explicit WalkFront(int capacity)
+      : x(capacity),
+        y(capacity),
+        z(capacity),
+        radius(capacity),
+        other(capacity),
+        vertex(capacity),
+        face(capacity),
+        steps(capacity),
+        key(capacity) {}
+
+  // copies walk from into slot to
+  void move(int from, int to) {
+    x[to] = x[from];
+    y[to] = y[from];
+    z[to] = z[from];
+    radius[to] = radius[from];
+    other[to] = other[from];
+    vertex[to] = vertex[from];
+    face[to] = face[from];
+    steps[to] = steps[from];
+    key[to] = key[from];
+  }
+};
+
+// Terminal points of the walks of one block, shaded together once the block
+// is done. Sorted by face, the weights are computed in batches over one
+// face at a time instead of per walk with random access to the faces.
+struct TerminalBuffer {
+  // in the order the walks ended
+  std::vector<int> vertex, face;
+  AlignedVecd x, y, z;
+  // by face, face f is [face_start[f], face_start[f + 1])
+  std::vector<int> face_start;
+  std::vector<int> sorted_vertex;
+  AlignedVecd sorted_x, sorted_y, sorted_z;
+  // closestFaceWeights of the sorted points
+  AlignedVecd weights;
+
+  void add(int vertex, int face, double x, double y, double z);
+  // counting sort of the points by face
+  void sort_by_face(int n_faces);
+  void clear();
+};
+
+}  // namespace StWarp
+
+#endif  // STWARP_WAVEFRONT_H_
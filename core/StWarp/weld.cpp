@@ -0,0 +1,70 @@
+#include "StWarp/weld.h"
+
+#include <cmath>
+
+namespace StWarp {
+
+PointHash::PointHash(const MatxXd& points, double tolerance)
+    : points(points), tolerance(tolerance), next(points.rows(), -1) {
+  origin = points.rows() > 0 ? Vec3d(points.colwise().minCoeff().transpose())
+                             : Vec3d::Zero();
+}
+
+Vec3i PointHash::cell(const Vec3d& p) const {
+  return ((p - origin) / tolerance).array().floor().cast<int>();
+}
+
+int PointHash::find(const Vec3d& p) const {
+  const double tol2 = tolerance * tolerance;
+  Vec3i c = cell(p);
+  for (int dx = -1; dx <= 1; dx++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dz = -1; dz <= 1; dz++) {
+        auto it = head.find(c + Vec3i(dx, dy, dz));
+        if (it == head.end()) continue;
+        for (int k = it->second; k >= 0; k = next[k]) {
+          if ((points.row(k).transpose() - p).squaredNorm() <= tol2) return k;
+        }
+      }
+    }
+  }
+  return -1;
+}
+
+void PointHash::add(int index) {
+  Vec3i c = cell(points.row(index).transpose());
+  auto it = head.find(c);
+  next[index] = it == head.end() ? -1 : it->second;
+  head[c] = index;
+}
+
+MatxXd weldPoints(const MatxXd& points, double tolerance, Vecxi& point_map) {
+  int n_points = points.rows();
+  point_map.resize(n_points);
+  if (tolerance <= 0.0) {
+    for (int i = 0; i < n_points; i++) point_map[i] = i;
+    return points;
+  }
+
+  PointHash hash(points, tolerance);
+  std::vector<int> unique;
+  Vecxi unique_row(n_points);
+  for (int i = 0; i < n_points; i++) {
+    int match = hash.find(points.row(i).transpose());
+    if (match < 0) {
+      unique_row[i] = unique.size();
+      unique.push_back(i);
+      hash.add(i);
+      point_map[i] = unique_row[i];
+    } else {
+      point_map[i] = unique_row[match];
+    }
+  }
+
+  MatxXd welded(unique.size(), points.cols());
+  for (size_t u = 0; u < unique.size(); u++)
+    welded.row(u) = points.row(unique[u]);
+  return welded;
+}
+
+}  // namespace StWarp
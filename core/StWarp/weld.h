@@ -0,0 +1,46 @@
+#ifndef STWARP_WELD_H_
+#define STWARP_WELD_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "StWarp/type.h"
+
+namespace StWarp {
+
+// Spatial hash of points for lookups within a tolerance, the cells are of
+// size tolerance so a match is at most one cell away.
+class PointHash {
+ public:
+  PointHash(const MatxXd& points, double tolerance);
+
+  // index of a point added before within tolerance of p, or -1
+  int find(const Vec3d& p) const;
+  void add(int index);
+
+ private:
+  struct CellHash {
+    size_t operator()(const Vec3i& c) const {
+      return (size_t)c(0) * 73856093u ^ (size_t)c(1) * 19349663u ^
+             (size_t)c(2) * 83492791u;
+    }
+  };
+  Vec3i cell(const Vec3d& p) const;
+
+  const MatxXd& points;
+  double tolerance;
+  Vec3d origin;
+  // points of a cell are chained through next
+  std::unordered_map<Vec3i, int, CellHash> head;
+  std::vector<int> next;
+};
+
+// Merges points closer than tolerance, e.g. vertices split along UV seams
+// or hard edges. Returns the unique points, each the first of its group in
+// input order, and sets point_map[i] to the unique row of points.row(i).
+// A tolerance <= 0 keeps every point.
+MatxXd weldPoints(const MatxXd& points, double tolerance, Vecxi& point_map);
+
+}  // namespace StWarp
+
+#endif  // STWARP_WELD_H_
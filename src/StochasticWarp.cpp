@@ -6,7 +6,10 @@
 #include <maya/MSelectionList.h>
 #include <maya/MGlobal.h>
 #include <maya/MFnDependencyNode.h>
+#include <maya/MDoubleArray.h>
 #include <maya/MFnDoubleArrayData.h>
+#include <maya/MFnIntArrayData.h>
+#include <maya/MIntArray.h>
 #include <maya/MFnGeometryFilter.h>
 #include <maya/MFnWeightGeometryFilter.h>
 #include <maya/MItGeometry.h>
@@ -19,9 +22,13 @@
 #include <maya/MDagModifier.h>
 #include <maya/MArgList.h>
 
+#include <algorithm>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "StWarp/type.h"
+#include "StWarp/parallel.h"
 #include "StWarp/solver.h"
 #include "StWarp/deform_node.h"
 // #include "StWarp/st_deformer.h"
@@ -37,6 +44,54 @@ class StochasticWarp : public MPxCommand {
 
 const char* StochasticWarp::kName = "StochasticWarp";
 
+// Value following a flag such as "-smooth 10", or fallback if the flag is not
+// given.
+static int intFlag(const MArgList& args, const char* shortName,
+                   const char* longName, int fallback) {
+  unsigned int idx = args.flagIndex(shortName, longName);
+  if (idx == MArgList::kInvalidArgIndex) return fallback;
+  MStatus status;
+  int value = args.asInt(idx + 1, &status);
+  return status == MS::kSuccess ? value : fallback;
+}
+
+static double doubleFlag(const MArgList& args, const char* shortName,
+                         const char* longName, double fallback) {
+  unsigned int idx = args.flagIndex(shortName, longName);
+  if (idx == MArgList::kInvalidArgIndex) return fallback;
+  MStatus status;
+  double value = args.asDouble(idx + 1, &status);
+  return status == MS::kSuccess ? value : fallback;
+}
+
+static MString stringFlag(const MArgList& args, const char* shortName,
+                          const char* longName, const MString& fallback) {
+  unsigned int idx = args.flagIndex(shortName, longName);
+  if (idx == MArgList::kInvalidArgIndex) return fallback;
+  MStatus status;
+  MString value = args.asString(idx + 1, &status);
+  return status == MS::kSuccess ? value : fallback;
+}
+
+// Values of a flag given several times, such as "-merge a -merge b".
+static std::vector<std::string> stringFlags(const MArgList& args,
+                                            const char* shortName,
+                                            const char* longName) {
+  std::vector<std::string> values;
+  for (unsigned int idx = 0; idx + 1 < args.length(); idx++) {
+    MString flag = args.asString(idx);
+    if (flag != shortName && flag != longName) continue;
+    values.push_back(args.asString(idx + 1).asChar());
+    idx++;
+  }
+  return values;
+}
+
+static bool hasFlag(const MArgList& args, const char* shortName,
+                    const char* longName) {
+  return args.flagIndex(shortName, longName) != MArgList::kInvalidArgIndex;
+}
+
 MStatus StochasticWarp::doIt(const MArgList& args) {
   MStatus status;
 
@@ -44,8 +99,9 @@ MStatus StochasticWarp::doIt(const MArgList& args) {
 
   MGlobal::getActiveSelectionList(selectionList, true);
 
-  if (selectionList.length() != 2) {
-    MGlobal::displayError("Please select exactly two mesh objects.");
+  if (selectionList.length() != 2 && selectionList.length() != 3) {
+    MGlobal::displayError(
+        "Please select two mesh objects, and optionally a proxy mesh.");
     return MS::kFailure;
   }
 
@@ -66,14 +122,63 @@ MStatus StochasticWarp::doIt(const MArgList& args) {
     return MS::kFailure;
   }
 
+  MDagPath proxyMeshDagPath;
+  bool hasProxyMesh = selectionList.length() == 3;
+  if (hasProxyMesh) {
+    selectionList.getDagPath(2, proxyMeshDagPath, component);
+  }
+
+  // -backend: openmp, tbb or pool, the threads of the solver and of the
+  // deformers evaluated afterwards. tbb shares Maya's threads and falls
+  // back to pool if the plugin was built without it.
+  // -threads: at most this many threads, 0 for all cpus of the process
+  // -affinity: cpu list such as 0-7,16 for the pool threads, the other
+  // backends only use as many threads
+  // -pinThreads: on for one pool thread per cpu ordered by NUMA node, every
+  // thread keeps working on the vertices whose memory it touched first, off
+  // to let the threads move again
+  MString backend = stringFlag(args, "-bk", "-backend", "");
+  if (backend.length() > 0) {
+    if (backend == "openmp") {
+      StWarp::setParallelBackend(StWarp::ParallelBackend::kOpenMP);
+    } else if (backend == "tbb") {
+      StWarp::setParallelBackend(StWarp::ParallelBackend::kTBB);
+    } else if (backend == "pool") {
+      StWarp::setParallelBackend(StWarp::ParallelBackend::kThreadPool);
+    } else {
+      MGlobal::displayError("-backend expects openmp, tbb or pool.");
+      return MS::kFailure;
+    }
+  }
+  if (hasFlag(args, "-th", "-threads")) {
+    StWarp::setMaxThreads(intFlag(args, "-th", "-threads", 0));
+  }
+  MString affinity = stringFlag(args, "-af", "-affinity", "");
+  if (affinity.length() > 0) {
+    std::vector<int> cpus;
+    if (!StWarp::parseCpuList(affinity.asChar(), cpus)) {
+      MGlobal::displayError("-affinity expects a cpu list such as 0-7,16.");
+      return MS::kFailure;
+    }
+    StWarp::setThreadAffinity(cpus);
+  }
+  MString pin = stringFlag(args, "-pin", "-pinThreads", "");
+  if (pin.length() > 0) {
+    if (pin != "on" && pin != "off") {
+      MGlobal::displayError("-pinThreads expects on or off.");
+      return MS::kFailure;
+    }
+    StWarp::setThreadPinning(pin == "on");
+  }
+
   StWarp::StoWarpSolver solver(cageFn, meshFn);
 
   // 100: number of max steps, 100 should be enough
   // 1e-6: define how close the sample point should be to the cage
   // 200: number of walks, more walks will give better results
   int n_walks = 200;
-  if (args.length() > 0) {
-    n_walks = args.asInt(0);
+  if (args.length() > 0 && args.asString(0).asChar()[0] != '-') {
+    n_walks = args.asInt(0, &status);
     if (status != MS::kSuccess) {
       MGlobal::displayError(
           "Invalid argument for number of walks. Using default value 200.");
@@ -81,7 +186,175 @@ MStatus StochasticWarp::doIt(const MArgList& args) {
     }
   }
 
-  solver.walk_on_sphere(100, 1e-6, n_walks);
+  // -smooth: number of laplacian smoothing sweeps after the walks, 0 disables
+  // -smoothStrength: diffusion time of the smoothing
+  // -chebyshev: accelerate the sweeps, fewer sweeps reach the same result
+  int smooth_iterations = intFlag(args, "-s", "-smooth", 0);
+  double smooth_strength = doubleFlag(args, "-ss", "-smoothStrength", 1.0);
+  StWarp::SmoothingScheme smooth_scheme =
+      hasFlag(args, "-ch", "-chebyshev") ? StWarp::SmoothingScheme::kChebyshev
+                                         : StWarp::SmoothingScheme::kJacobi;
+
+  // -proxy: walk on a vertex clustered proxy with this many cells along the
+  // longest side of the mesh, a third selected mesh is used as proxy instead
+  // -correction: walks on the full mesh refining the proxy weights
+  int proxy_resolution = intFlag(args, "-p", "-proxy", 0);
+  int correction_walks = intFlag(args, "-cw", "-correction", 0);
+
+  // -distanceGrid: cells along the longest side of a distance grid over the
+  // cage, far from the cage the walks step using the grid alone
+  int grid_resolution = intFlag(args, "-dg", "-distanceGrid", 0);
+  if (grid_resolution > 0) {
+    solver.use_distance_grid(grid_resolution);
+  }
+
+  // -wavefront: advance batches of walks step by step instead of one walk
+  // per vertex at a time
+  // -deferredShading: wavefront walks with the weights of their end points
+  // computed in batches per cage face
+  if (hasFlag(args, "-wf", "-wavefront")) {
+    solver.walk_engine = StWarp::WalkEngine::kWavefront;
+  }
+  if (hasFlag(args, "-dsh", "-deferredShading")) {
+    solver.walk_engine = StWarp::WalkEngine::kWavefront;
+    solver.deferred_shading = true;
+  }
+
+  // -workStealing: run the walks as small tasks balanced by work stealing,
+  // which keeps all cores busy however much the walk lengths vary
+  if (hasFlag(args, "-ws", "-workStealing")) {
+    solver.walk_engine = StWarp::WalkEngine::kWorkStealing;
+  }
+
+  // -floatWalks: walk positions in float in a normalized cage frame, for
+  // the wavefront and work stealing engines
+  if (hasFlag(args, "-flw", "-floatWalks")) {
+    if (solver.walk_engine == StWarp::WalkEngine::kPerVertex)
+      solver.walk_engine = StWarp::WalkEngine::kWavefront;
+    solver.float_walks = true;
+  }
+
+  // -symmetry: x, y or z mirror plane through the cage center, or auto to
+  // detect it. Only one half of the mesh is walked, the other half takes
+  // the mirrored weights.
+  MString symmetry = stringFlag(args, "-sym", "-symmetry", "");
+  if (symmetry.length() > 0) {
+    int axis = -1;
+    if (symmetry == "x") axis = 0;
+    if (symmetry == "y") axis = 1;
+    if (symmetry == "z") axis = 2;
+    if (axis < 0 && symmetry != "auto") {
+      MGlobal::displayError("-symmetry expects x, y, z or auto.");
+      return MS::kFailure;
+    }
+    solver.use_mirror_symmetry(axis);
+  }
+
+  // -shard, -shardCount: walk only shard <index> of <count> vertex ranges,
+  // e.g. on one farm node, and write the sums to -shardFile instead of
+  // binding. -merge: sum the shard files of all ranges, given once each,
+  // and bind. Use the same mesh, cage and flags for every shard.
+  int shard_count = intFlag(args, "-shc", "-shardCount", 0);
+  MString shard_file = stringFlag(args, "-shf", "-shardFile", "");
+  std::vector<std::string> merge_files = stringFlags(args, "-mg", "-merge");
+  if (shard_count > 0 || !merge_files.empty()) {
+    if (hasProxyMesh || proxy_resolution > 0) {
+      MGlobal::displayError("Shards do not support proxy meshes.");
+      return MS::kFailure;
+    }
+  }
+  if (shard_count > 0) {
+    int shard = intFlag(args, "-sh", "-shard", -1);
+    if (shard < 0 || shard >= shard_count || shard_file.length() == 0) {
+      MGlobal::displayError(
+          "-shardCount needs -shard in [0, count) and -shardFile.");
+      return MS::kFailure;
+    }
+    // the per vertex engine walks every vertex with unseeded streams, work
+    // stealing adds up a block's walks in the order the threads finish them
+    if (solver.walk_engine == StWarp::WalkEngine::kWorkStealing) {
+      MGlobal::displayError("Shards do not support -workStealing.");
+      return MS::kFailure;
+    }
+    if (solver.walk_engine == StWarp::WalkEngine::kPerVertex)
+      solver.walk_engine = StWarp::WalkEngine::kWavefront;
+    solver.shard = shard;
+    solver.n_shards = shard_count;
+    solver.accumulate_walks(100, 1e-6, n_walks);
+    solver.save_shard(shard_file.asChar());
+    return solver.status;
+  }
+
+  // -outOfCore: for weights larger than memory, walk and solve the mesh in
+  // tiles of at most -memoryBudget megabytes (default 1024) and write the
+  // weights to this file instead of binding
+  MString weight_file = stringFlag(args, "-ooc", "-outOfCore", "");
+  if (weight_file.length() > 0) {
+    if (hasProxyMesh || proxy_resolution > 0 || !merge_files.empty() ||
+        smooth_iterations > 0) {
+      MGlobal::displayError(
+          "-outOfCore does not support proxies, shards or smoothing.");
+      return MS::kFailure;
+    }
+    if (solver.walk_engine == StWarp::WalkEngine::kWorkStealing) {
+      MGlobal::displayError("-outOfCore does not support -workStealing.");
+      return MS::kFailure;
+    }
+    double budget = doubleFlag(args, "-mb", "-memoryBudget", 1024.0);
+    solver.solve_to_file(weight_file.asChar(), 100, 1e-6, n_walks,
+                         (size_t)(std::max(budget, 1.0) * 1024 * 1024));
+    return solver.status;
+  }
+
+  // the solver writes the weights straight into the array of the data
+  // object that is set on the stweights attribute below
+  MFnDoubleArrayData weightsDataFn;
+  MObject weightsDataObj = weightsDataFn.create(&status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MDoubleArray weightsArray = weightsDataFn.array();
+  weightsArray.setLength(solver.n_mesh_verts * solver.n_cage_verts);
+  if (weightsArray.length() > 0) solver.set_weight_buffer(&weightsArray[0]);
+
+  if (!merge_files.empty()) {
+    solver.merge_shards(merge_files, 1e-6);
+  } else if (hasProxyMesh || proxy_resolution > 0) {
+    StWarp::ProxyMesh proxy;
+    if (hasProxyMesh) {
+      MFnMesh proxyFn(proxyMeshDagPath, &status);
+      if (status != MS::kSuccess) {
+        MString errorMsg = proxyMeshDagPath.fullPathName() + " is not a mesh.";
+        MGlobal::displayError(errorMsg);
+        return MS::kFailure;
+      }
+      StWarp::MatxXd points;
+      StWarp::Vecxi counts, connects;
+      if (StWarp::getMeshPoints(proxyFn, points) != MS::kSuccess ||
+          StWarp::getMeshTopology(proxyFn, counts, connects) !=
+              MS::kSuccess) {
+        MString errorMsg =
+            "Failed to read proxy mesh " + proxyMeshDagPath.fullPathName();
+        MGlobal::displayError(errorMsg);
+        return MS::kFailure;
+      }
+      proxy = StWarp::triangulateMesh(points, counts, connects);
+    } else {
+      StWarp::Vecxi counts, connects;
+      if (StWarp::getMeshTopology(meshFn, counts, connects) != MS::kSuccess) {
+        MString errorMsg =
+            "Failed to read mesh " + originMeshDagPath.fullPathName();
+        MGlobal::displayError(errorMsg);
+        return MS::kFailure;
+      }
+      proxy = StWarp::decimateMesh(solver.mesh_verts, counts, connects,
+                                   proxy_resolution);
+    }
+    solver.walk_on_proxy(proxy, 100, 1e-6, n_walks, correction_walks);
+  } else {
+    solver.walk_on_sphere(100, 1e-6, n_walks);
+  }
+  if (smooth_iterations > 0) {
+    solver.smooth_weights(smooth_iterations, smooth_strength, smooth_scheme);
+  }
 
   if (solver.status != MS::kSuccess) {
     MGlobal::displayError("Failed to initialize solver.");
@@ -139,10 +412,6 @@ MStatus StochasticWarp::doIt(const MArgList& args) {
     return status;
   }
 
-  MFnDoubleArrayData weightsDataFn;
-  MObject weightsDataObj =
-      weightsDataFn.create(solver.harmonic_weights_maya, &status);
-  CHECK_MSTATUS_AND_RETURN_IT(status);
   MPlug deformerWeightsPlug = deformerFn.findPlug("stweights", &status);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
@@ -150,6 +419,20 @@ MStatus StochasticWarp::doIt(const MArgList& args) {
   status = deformerWeightsPlug.setValue(weightsDataObj);
   CHECK_MSTATUS_AND_RETURN_IT(status);
 
+  // vertices found outside the cage, see "getAttr <deformer>.stexterior"
+  MIntArray exterior(solver.n_mesh_verts, 0);
+  if (solver.exterior.size() > 0) {
+    for (int i = 0; i < solver.n_mesh_verts; i++)
+      exterior[i] = solver.exterior[solver.solve_row[i]];
+  }
+  MFnIntArrayData exteriorDataFn;
+  MObject exteriorDataObj = exteriorDataFn.create(exterior, &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  MPlug deformerExteriorPlug = deformerFn.findPlug("stexterior", &status);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+  status = deformerExteriorPlug.setValue(exteriorDataObj);
+  CHECK_MSTATUS_AND_RETURN_IT(status);
+
   MGlobal::displayInfo("Cage deformer created.");
 
   return MS::kSuccess;